@@ -0,0 +1,116 @@
+#include <stdlib.h>
+
+#include "bit-matrix.h"
+#include "bitvec.h"
+
+struct bit_matrix *bit_matrix_make(size_t size) {
+    // Round up to a size class, so that the searches below are
+    // compiled for a fixed row length.
+    size_t bits = size;
+    if (size <= 64)
+	bits = 64;
+    else if (size <= 128)
+	bits = 128;
+    else if (size <= 256)
+	bits = 256;
+    size_t words = bitvec_words(bits);
+    struct bit_matrix *m = calloc(1, sizeof *m
+				  + size * words * sizeof *m->rows);
+    m->size = size;
+    m->words = words;
+    return m;
+}
+
+// The first WORDS words of V, which may be shorter.
+static inline void load_words(unsigned long *d, const struct bitvec *v,
+			      size_t words) {
+    size_t n = bitvec_words(v->num_bits);
+    for (size_t i = 0; i < words; i++)
+	d[i] = i < n ? v->data[i] : 0;
+}
+
+/* Breadth-first search by levels: a level is bipartite with the next
+   one, so the graph is bipartite iff no edge stays within a level.  */
+static inline bool two_coloring(const struct bit_matrix *m,
+				const struct bitvec *active,
+				const struct bitvec *omit,
+				struct bitvec *colors, size_t words) {
+    unsigned long allowed[words], unseen[words];
+    unsigned long frontier[words], next[words];
+    load_words(allowed, active, words);
+    if (omit) {
+	unsigned long o[words];
+	load_words(o, omit, words);
+	for (size_t i = 0; i < words; i++)
+	    allowed[i] &= ~o[i];
+    }
+    for (size_t i = 0; i < words; i++)
+	unseen[i] = allowed[i];
+
+    for (size_t start = 0; start < words; start++) {
+	while (unseen[start]) {
+	    size_t v0 = start * BITS_PER_WORD + ctzl(unseen[start]);
+	    bool c = bitvec_get(colors, v0);
+	    for (size_t i = 0; i < words; i++)
+		frontier[i] = 0;
+	    frontier[start] = unseen[start] & -unseen[start];
+	    unseen[start] &= unseen[start] - 1;
+	    bool more;
+	    do {
+		for (size_t i = 0; i < words; i++)
+		    next[i] = 0;
+		for (size_t i = 0; i < words; i++)
+		    for (unsigned long f = frontier[i]; f; f &= f - 1) {
+			size_t v = i * BITS_PER_WORD + ctzl(f);
+			const unsigned long *row = bit_matrix_row(m, v);
+			unsigned long conflict = 0;
+			for (size_t j = 0; j < words; j++) {
+			    conflict |= row[j] & frontier[j];
+			    next[j] |= row[j] & unseen[j];
+			}
+			if (conflict)
+			    return false;
+			bitvec_put(colors, v, c);
+		    }
+		more = false;
+		for (size_t i = 0; i < words; i++) {
+		    unseen[i] &= ~next[i];
+		    frontier[i] = next[i];
+		    more |= next[i] != 0;
+		}
+		c = !c;
+	    } while (more);
+	}
+    }
+    return true;
+}
+
+static bool two_coloring_64(const struct bit_matrix *m,
+			    const struct bitvec *active,
+			    const struct bitvec *omit, struct bitvec *colors) {
+    return two_coloring(m, active, omit, colors, bitvec_words(64));
+}
+
+static bool two_coloring_128(const struct bit_matrix *m,
+			     const struct bitvec *active,
+			     const struct bitvec *omit, struct bitvec *colors) {
+    return two_coloring(m, active, omit, colors, bitvec_words(128));
+}
+
+static bool two_coloring_256(const struct bit_matrix *m,
+			     const struct bitvec *active,
+			     const struct bitvec *omit, struct bitvec *colors) {
+    return two_coloring(m, active, omit, colors, bitvec_words(256));
+}
+
+bool bit_matrix_two_coloring(const struct bit_matrix *m,
+			     const struct bitvec *active,
+			     const struct bitvec *omit, struct bitvec *colors) {
+    assert(colors->num_bits >= m->size);
+    switch (m->words * BITS_PER_WORD) {
+    case 64:  return two_coloring_64(m, active, omit, colors);
+    case 128: return two_coloring_128(m, active, omit, colors);
+    case 256: return two_coloring_256(m, active, omit, colors);
+    default:  return two_coloring(m, active, omit, colors, m->words);
+    }
+}
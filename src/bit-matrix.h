@@ -0,0 +1,42 @@
+#ifndef BIT_MATRIX_H
+#define BIT_MATRIX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "bitvec.h"
+
+/* Graphs with at most this many vertices also get an adjacency
+   matrix with one row of bits per vertex. Searches then expand a
+   whole frontier with a few word operations per vertex instead of
+   walking the neighbor lists.  */
+#ifndef BIT_MATRIX_MAX_SIZE
+#define BIT_MATRIX_MAX_SIZE 256
+#endif
+
+struct bit_matrix {
+    size_t size;
+    size_t words;		// per row: enough for 64, 128, 256 or SIZE bits
+    unsigned long rows[];
+};
+
+struct bit_matrix *bit_matrix_make(size_t size);
+static inline void bit_matrix_free(struct bit_matrix *m) { free(m); }
+
+static inline const unsigned long *bit_matrix_row(const struct bit_matrix *m,
+						  size_t v) {
+    return m->rows + v * m->words;
+}
+
+static inline void bit_matrix_set(struct bit_matrix *m, size_t v, size_t w) {
+    assert(v < m->size && w < m->size);
+    m->rows[v * m->words + w / BITS_PER_WORD] |= 1UL << (w % BITS_PER_WORD);
+}
+
+/* Two-color the subgraph induced by the vertices in ACTIVE that are
+   not in OMIT (which may be NULL), like csr_graph_two_coloring.  */
+bool bit_matrix_two_coloring(const struct bit_matrix *m,
+			     const struct bitvec *active,
+			     const struct bitvec *omit, struct bitvec *colors);
+
+#endif	// BIT_MATRIX_H
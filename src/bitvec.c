@@ -4,6 +4,20 @@
 
 #include "bitvec.h"
 
+/* The loops over whole vectors are compiled for several instruction
+   sets (AVX-512 with and without vector popcount, AVX2, and plain
+   x86-64), and the dynamic loader picks the best one the CPU has. The
+   binary then runs anywhere without giving up the wide instructions
+   where they exist.  */
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 8	\
+    && defined(__x86_64__) && defined(__linux__)
+#define KERNEL __attribute__((target_clones("arch=icelake-server",	\
+					    "arch=skylake-avx512",	\
+					    "arch=haswell", "default")))
+#else
+#define KERNEL
+#endif
+
 struct bitvec *bitvec_make(size_t num_bits) {
     struct bitvec *v = calloc(sizeof (struct bitvec) + bitvec_bytes(num_bits), 1);
     v->num_bits = num_bits;
@@ -44,7 +58,7 @@ size_t bitvec_find(const struct bitvec *v, size_t n) {
     return BITVEC_NOT_FOUND;
 }
 
-size_t bitvec_count(const struct bitvec *v) {
+KERNEL size_t bitvec_count(const struct bitvec *v) {
     size_t count = 0;
     for (size_t w = 0; w < bitvec_words(v->num_bits); ++w)
         count += popcountl(v->data[w]);
@@ -53,18 +67,41 @@ size_t bitvec_count(const struct bitvec *v) {
 }
 
 static inline size_t min(size_t x, size_t y) { return x < y ? x : y; }
-void bitvec_setminus(struct bitvec *d, const struct bitvec *s) {
+KERNEL void bitvec_setminus(struct bitvec *d, const struct bitvec *s) {
     size_t words = min(bitvec_words(s->num_bits), bitvec_words(d->num_bits));
     for (size_t w = 0; w < words; ++w)
 	d->data[w] &= ~s->data[w];
 }
 
-void bitvec_join(struct bitvec *d, const struct bitvec *s) {
+KERNEL void bitvec_join(struct bitvec *d, const struct bitvec *s) {
     size_t words = min(bitvec_words(s->num_bits), bitvec_words(d->num_bits));
     for (size_t w = 0; w < words; ++w)
 	d->data[w] |= s->data[w];
 }
 
+KERNEL size_t bitvec_count_setminus(const struct bitvec *s,
+				    const struct bitvec *t) {
+    size_t words = bitvec_words(s->num_bits);
+    size_t common = min(words, bitvec_words(t->num_bits));
+    size_t count = 0;
+    for (size_t w = 0; w < common; ++w)
+	count += popcountl(s->data[w] & ~t->data[w]);
+    for (size_t w = common; w < words; ++w)
+	count += popcountl(s->data[w]);
+    return count;
+}
+
+KERNEL void bitvec_copy_setminus(struct bitvec *d, const struct bitvec *s,
+				 const struct bitvec *t) {
+    assert(d->num_bits == s->num_bits);
+    size_t words = bitvec_words(s->num_bits);
+    size_t common = min(words, bitvec_words(t->num_bits));
+    for (size_t w = 0; w < common; ++w)
+	d->data[w] = s->data[w] & ~t->data[w];
+    for (size_t w = common; w < words; ++w)
+	d->data[w] = s->data[w];
+}
+
 void bitvec_output(const struct bitvec *v, FILE *stream) {
     fprintf(stream, "[%zu/%lu:", bitvec_count(v), v->num_bits);
     for (size_t i = bitvec_find(v, 0); i != BITVEC_NOT_FOUND;
@@ -86,12 +123,17 @@ void bitvec_fill(struct bitvec *v) {
 }
 
 void bitvec_invert(struct bitvec *v) {
-    size_t words = bitvec_words(v->num_bits);
+    bitvec_copy_invert(v, v);
+}
+
+KERNEL void bitvec_copy_invert(struct bitvec *d, const struct bitvec *s) {
+    assert(d->num_bits == s->num_bits);
+    size_t words = bitvec_words(s->num_bits);
 
     for (size_t w = 0; w < words; ++w)
-	v->data[w] = ~v->data[w];
+	d->data[w] = ~s->data[w];
 
-    unsigned long padbits = BITS_PER_WORD * words - v->num_bits;
+    unsigned long padbits = BITS_PER_WORD * words - s->num_bits;
     if (padbits)
-	v->data[words - 1] &= ~0UL >> padbits;
+	d->data[words - 1] &= ~0UL >> padbits;
 }
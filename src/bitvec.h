@@ -93,6 +93,11 @@ void bitvec_fill(struct bitvec *v);
 void bitvec_invert(struct bitvec *v);
 void bitvec_setminus(struct bitvec *d, const struct bitvec *s);
 void bitvec_join(struct bitvec *d, const struct bitvec *s);
+// Fused operations: the size of S \ T, D = S \ T and D = ~S.
+size_t bitvec_count_setminus(const struct bitvec *s, const struct bitvec *t);
+void bitvec_copy_setminus(struct bitvec *d, const struct bitvec *s,
+			  const struct bitvec *t);
+void bitvec_copy_invert(struct bitvec *d, const struct bitvec *s);
 void bitvec_output(const struct bitvec *v, FILE *stream);
 static inline void bitvec_dump(const struct bitvec *v) {
     bitvec_output(v, stderr);
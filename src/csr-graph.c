@@ -0,0 +1,498 @@
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bitvec.h"
+#include "csr-graph.h"
+#include "graph.h"
+
+struct csr_graph *csr_graph_alloc(size_t size) {
+    struct csr_graph *g = malloc(sizeof *g);
+    g->size = size;
+    g->offsets = calloc(size + 1, sizeof *g->offsets);
+    g->neighbors = NULL;
+    g->active = bitvec_make(size);
+    g->matrix = size <= BIT_MATRIX_MAX_SIZE ? bit_matrix_make(size) : NULL;
+    g->mapping = NULL;
+    return g;
+}
+
+void csr_graph_start_rows(struct csr_graph *g) {
+    size_t start = 0;
+    for (size_t v = 0; v < g->size; v++) {
+	size_t deg = g->offsets[v + 1];
+	g->offsets[v + 1] = start;
+	start += deg;
+    }
+    g->neighbors = malloc(start * sizeof *g->neighbors);
+}
+
+void csr_graph_free(struct csr_graph *g) {
+    if (g->matrix)
+	bit_matrix_free(g->matrix);
+    if (g->mapping) {
+	munmap(g->mapping, g->mapping_size);
+	free(g);
+	return;
+    }
+    free(g->offsets);
+    free(g->neighbors);
+    bitvec_free(g->active);
+    free(g);
+}
+
+struct csr_graph *csr_graph_make(const struct graph *g) {
+    struct csr_graph *csr = csr_graph_alloc(graph_size(g));
+    for (vertex v = 0; v < g->size; v++)
+	if (graph_vertex_exists(g, v))
+	    csr->offsets[v + 1] = g->vertices[v]->deg;
+    csr_graph_start_rows(csr);
+    for (vertex v = 0; v < g->size; v++) {
+	if (!graph_vertex_exists(g, v))
+	    continue;
+	csr_graph_vertex_enable(csr, v);
+	vertex w;
+	GRAPH_NEIGHBORS_ITER(g, v, w)
+	    csr_graph_append(csr, v, w);
+    }
+    return csr;
+}
+
+struct csr_graph *csr_graph_subgraph(const struct csr_graph *g,
+				     const struct bitvec *s) {
+    struct csr_graph *sub = csr_graph_alloc(g->size);
+    vertex w;
+    for (vertex v = 0; v < g->size; v++)
+	if (bitvec_get(s, v) && csr_graph_vertex_exists(g, v))
+	    CSR_NEIGHBORS_ITER(g, v, w)
+		if (bitvec_get(s, w))
+		    csr_graph_count_arc(sub, v);
+    csr_graph_start_rows(sub);
+    for (vertex v = 0; v < g->size; v++) {
+	if (!bitvec_get(s, v) || !csr_graph_vertex_exists(g, v))
+	    continue;
+	csr_graph_vertex_enable(sub, v);
+	CSR_NEIGHBORS_ITER(g, v, w)
+	    if (bitvec_get(s, w))
+		csr_graph_append(sub, v, w);
+    }
+    return sub;
+}
+
+size_t csr_graph_num_vertices(const struct csr_graph *g) {
+    return bitvec_count(g->active);
+}
+
+size_t csr_graph_num_edges(const struct csr_graph *g) {
+    size_t n = 0;
+    for (vertex v = 0; v < g->size; v++)
+	if (csr_graph_vertex_exists(g, v))
+	    n += csr_graph_deg(g, v);
+    assert ((n % 2) == 0);
+    return n / 2;
+}
+
+bool csr_graph_two_coloring(const struct csr_graph *g,
+			    const struct bitvec *omit, struct bitvec *colors) {
+    size_t size = csr_graph_size(g);
+    assert(colors->num_bits >= size);
+    assert(!omit || bitvec_size(omit) == size);
+    if (g->matrix)
+	return bit_matrix_two_coloring(g->matrix, g->active, omit, colors);
+    ALLOCA_BITVEC(seen, size);
+    if (omit)
+	bitvec_copy(seen, omit);
+    vertex queue[size];
+    vertex *qhead = queue, *qtail = queue;
+
+    for (size_t v0 = 0; v0 < size; v0++) {
+	if (!csr_graph_vertex_exists(g, v0) || bitvec_get(seen, v0))
+	    continue;
+	assert(qtail <= queue + size);
+	*qtail++ = v0;
+	bitvec_set(seen, v0);
+	do {
+	    vertex v = *qhead++, w;
+	    bool c = bitvec_get(colors, v);
+	    CSR_NEIGHBORS_ITER(g, v, w) {
+		if (!csr_graph_vertex_exists(g, w)
+		    || (omit && bitvec_get(omit, w)))
+		    continue;
+		if (!bitvec_get(seen, w)) {
+		    bitvec_put(colors, w, !c);
+		    assert(qtail < queue + size);
+		    *qtail++ = w;
+		    bitvec_set(seen, w);
+		} else {
+		    if (bitvec_get(colors, w) == c)
+			return false;
+		}
+	    }
+	} while (qhead != qtail);
+    }
+    return true;
+}
+
+bool csr_graph_is_bipartite(const struct csr_graph *g) {
+    ALLOCA_BITVEC(colors, g->size);
+    return csr_graph_two_coloring(g, NULL, colors);
+}
+
+struct graph *csr_graph_thaw(const struct csr_graph *g) {
+    struct graph *g2 = graph_make_arena(g->size, g->offsets[g->size]);
+    for (vertex v = 0; v < g->size; v++)
+	if (csr_graph_vertex_exists(g, v))
+	    graph_set_neighbors(g2, v, g->neighbors + g->offsets[v],
+				csr_graph_deg(g, v));
+    return g2;
+}
+
+struct csr_graph *csr_graph_permute(const struct csr_graph *g,
+				    const vertex *order) {
+    vertex *pos = malloc(g->size * sizeof *pos);
+    for (vertex i = 0; i < g->size; i++)
+	pos[order[i]] = i;
+    struct csr_graph *p = csr_graph_alloc(g->size);
+    for (vertex i = 0; i < g->size; i++)
+	if (csr_graph_vertex_exists(g, order[i]))
+	    p->offsets[i + 1] = csr_graph_deg(g, order[i]);
+    csr_graph_start_rows(p);
+    for (vertex i = 0; i < g->size; i++) {
+	vertex v = order[i], w;
+	if (!csr_graph_vertex_exists(g, v))
+	    continue;
+	csr_graph_vertex_enable(p, i);
+	CSR_NEIGHBORS_ITER(g, v, w)
+	    csr_graph_append(p, i, pos[w]);
+    }
+    free(pos);
+    return p;
+}
+
+// Existing vertices by degree, ties broken by number.
+static size_t sort_by_degree(const struct csr_graph *g, bool descending,
+			     vertex *out) {
+    size_t max_deg = 0;
+    for (vertex v = 0; v < g->size; v++)
+	if (csr_graph_vertex_exists(g, v) && csr_graph_deg(g, v) > max_deg)
+	    max_deg = csr_graph_deg(g, v);
+    size_t *start = calloc(max_deg + 2, sizeof *start);
+#define BUCKET(v) (descending ? max_deg - csr_graph_deg(g, v)	\
+		   : csr_graph_deg(g, v))
+    for (vertex v = 0; v < g->size; v++)
+	if (csr_graph_vertex_exists(g, v))
+	    start[BUCKET(v) + 1]++;
+    for (size_t d = 0; d <= max_deg; d++)
+	start[d + 1] += start[d];
+    for (vertex v = 0; v < g->size; v++)
+	if (csr_graph_vertex_exists(g, v))
+	    out[start[BUCKET(v)]++] = v;
+#undef BUCKET
+    size_t n = start[max_deg];
+    free(start);
+    return n;
+}
+
+struct degree_key {
+    size_t deg;
+    vertex v;
+};
+
+static int cmp_degree_key(const void *p1, const void *p2) {
+    const struct degree_key *k1 = p1, *k2 = p2;
+    if (k1->deg != k2->deg)
+	return k1->deg < k2->deg ? -1 : 1;
+    return k1->v < k2->v ? -1 : k1->v > k2->v;
+}
+
+/* Breadth-first search of the existing vertices, starting new
+   components at the first unvisited vertex of STARTS. With
+   BY_DEGREE, the neighbors of each vertex are queued by ascending
+   degree, as in the Cuthill-McKee order.  */
+static size_t bfs_order(const struct csr_graph *g, const vertex *starts,
+			size_t num_starts, bool by_degree, vertex *queue) {
+    struct bitvec *seen = bitvec_make(g->size);
+    struct degree_key *keys = by_degree ? malloc(g->size * sizeof *keys)
+	: NULL;
+    vertex *qhead = queue, *qtail = queue;
+    for (size_t i = 0; i < num_starts; i++) {
+	if (bitvec_get(seen, starts[i]))
+	    continue;
+	*qtail++ = starts[i];
+	bitvec_set(seen, starts[i]);
+	while (qhead != qtail) {
+	    vertex v = *qhead++, w;
+	    vertex *added = qtail;
+	    CSR_NEIGHBORS_ITER(g, v, w)
+		if (csr_graph_vertex_exists(g, w) && !bitvec_get(seen, w)) {
+		    *qtail++ = w;
+		    bitvec_set(seen, w);
+		}
+	    if (by_degree && qtail - added > 1) {
+		size_t n = qtail - added;
+		for (size_t i = 0; i < n; i++)
+		    keys[i] = (struct degree_key)
+			{ csr_graph_deg(g, added[i]), added[i] };
+		qsort(keys, n, sizeof *keys, cmp_degree_key);
+		for (size_t i = 0; i < n; i++)
+		    added[i] = keys[i].v;
+	    }
+	}
+    }
+    free(keys);
+    bitvec_free(seen);
+    return qtail - queue;
+}
+
+/* Remove vertices of minimum degree one after another (Batagelj and
+   Zaversnik), and list them in reverse order of removal.  */
+static size_t degeneracy_order(const struct csr_graph *g, vertex *order) {
+    size_t *deg = malloc(g->size * sizeof *deg);
+    size_t *pos = malloc(g->size * sizeof *pos);
+    size_t max_deg = 0, n = 0;
+    for (vertex v = 0; v < g->size; v++) {
+	vertex w;
+	deg[v] = 0;
+	if (!csr_graph_vertex_exists(g, v))
+	    continue;
+	CSR_NEIGHBORS_ITER(g, v, w)
+	    if (csr_graph_vertex_exists(g, w))
+		deg[v]++;
+	if (deg[v] > max_deg)
+	    max_deg = deg[v];
+	n++;
+    }
+    // order[bin[d]..] are the remaining vertices of degree d.
+    size_t *bin = calloc(max_deg + 2, sizeof *bin);
+    for (vertex v = 0; v < g->size; v++)
+	if (csr_graph_vertex_exists(g, v))
+	    bin[deg[v] + 1]++;
+    for (size_t d = 0; d <= max_deg; d++)
+	bin[d + 1] += bin[d];
+    for (vertex v = 0; v < g->size; v++)
+	if (csr_graph_vertex_exists(g, v)) {
+	    pos[v] = bin[deg[v]]++;
+	    order[pos[v]] = v;
+	}
+    for (size_t d = max_deg + 1; d > 0; d--)
+	bin[d] = bin[d - 1];
+    bin[0] = 0;
+    for (size_t i = 0; i < n; i++) {
+	vertex v = order[i], w;
+	CSR_NEIGHBORS_ITER(g, v, w) {
+	    if (!csr_graph_vertex_exists(g, w) || deg[w] <= deg[v])
+		continue;
+	    // Move w to the front of its bin and shrink the bin.
+	    size_t pu = pos[w], pf = bin[deg[w]];
+	    vertex u = order[pf];
+	    order[pu] = u;
+	    pos[u] = pu;
+	    order[pf] = w;
+	    pos[w] = pf;
+	    bin[deg[w]]++;
+	    deg[w]--;
+	}
+    }
+    for (size_t i = 0; i < n / 2; i++) {
+	vertex v = order[i];
+	order[i] = order[n - 1 - i];
+	order[n - 1 - i] = v;
+    }
+    free(bin);
+    free(pos);
+    free(deg);
+    return n;
+}
+
+vertex *csr_graph_order(const struct csr_graph *g, enum csr_order kind) {
+    vertex *order = malloc(g->size * sizeof *order);
+    vertex *starts = NULL;
+    size_t n;
+    switch (kind) {
+    case CSR_ORDER_BFS:
+	starts = malloc(g->size * sizeof *starts);
+	n = 0;
+	for (vertex v = 0; v < g->size; v++)
+	    if (csr_graph_vertex_exists(g, v))
+		starts[n++] = v;
+	n = bfs_order(g, starts, n, false, order);
+	break;
+    case CSR_ORDER_RCM:
+	starts = malloc(g->size * sizeof *starts);
+	n = sort_by_degree(g, false, starts);
+	n = bfs_order(g, starts, n, true, order);
+	for (size_t i = 0; i < n / 2; i++) {
+	    vertex v = order[i];
+	    order[i] = order[n - 1 - i];
+	    order[n - 1 - i] = v;
+	}
+	break;
+    case CSR_ORDER_DEGREE:
+	n = sort_by_degree(g, true, order);
+	break;
+    case CSR_ORDER_DEGENERACY:
+	n = degeneracy_order(g, order);
+	break;
+    default:
+	abort();
+    }
+    free(starts);
+    for (vertex v = 0; v < g->size; v++)
+	if (!csr_graph_vertex_exists(g, v))
+	    order[n++] = v;
+    assert(n == g->size);
+    return order;
+}
+
+#define CSR_FILE_MAGIC	 "occ-csr\n"
+#define CSR_FILE_VERSION 1
+#define CSR_BYTE_ORDER	 0x01020304
+
+/* The header is followed by
+     size_t offsets[size + 1];
+     uint64_t name_offsets[size];	// into the name blob
+     struct bitvec active;		// with size bits
+     vertex neighbors[num_arcs];
+     char names[names_bytes];		// NUL terminated names
+   which keeps every array aligned.  */
+struct csr_file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t vertex_bytes, word_bytes;
+    uint64_t size, num_arcs, names_bytes;
+};
+
+bool csr_graph_write(const struct csr_graph *g, const char **names,
+		     FILE *stream) {
+    struct csr_file_header header = {
+	.magic = CSR_FILE_MAGIC,
+	.version = CSR_FILE_VERSION,
+	.byte_order = CSR_BYTE_ORDER,
+	.vertex_bytes = sizeof (vertex),
+	.word_bytes = sizeof (size_t),
+	.size = g->size,
+	.num_arcs = g->offsets[g->size],
+    };
+    uint64_t *name_offsets = malloc(g->size * sizeof *name_offsets);
+    for (vertex v = 0; v < g->size; v++) {
+	name_offsets[v] = header.names_bytes;
+	header.names_bytes += strlen(names[v]) + 1;
+    }
+    fwrite(&header, sizeof header, 1, stream);
+    fwrite(g->offsets, sizeof *g->offsets, g->size + 1, stream);
+    fwrite(name_offsets, sizeof *name_offsets, g->size, stream);
+    fwrite(g->active, 1, sizeof (struct bitvec) + bitvec_bytes(g->size),
+	   stream);
+    fwrite(g->neighbors, sizeof *g->neighbors, header.num_arcs, stream);
+    for (vertex v = 0; v < g->size; v++)
+	fwrite(names[v], 1, strlen(names[v]) + 1, stream);
+    free(name_offsets);
+    return !ferror(stream);
+}
+
+/* Check the arrays of a mapped graph once, so that a corrupt file
+   cannot make later loops index outside of the mapping.  */
+static bool csr_graph_valid(const struct csr_graph *g,
+			    const uint64_t *name_offsets, const char *names,
+			    uint64_t names_bytes) {
+    if (g->offsets[0] != 0)
+	return false;
+    for (vertex v = 0; v < g->size; v++)
+	if (g->offsets[v] > g->offsets[v + 1]
+	    || g->offsets[v + 1] > g->offsets[g->size])
+	    return false;
+    for (size_t i = 0; i < g->offsets[g->size]; i++)
+	if (g->neighbors[i] >= g->size)
+	    return false;
+    if (g->size > 0 && (names_bytes == 0 || names[names_bytes - 1] != '\0'))
+	return false;
+    for (vertex v = 0; v < g->size; v++)
+	if (name_offsets[v] >= names_bytes)
+	    return false;
+    return true;
+}
+
+struct csr_graph *csr_graph_map(const char *path, const char ***names_out) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+	perror(path);
+	exit(1);
+    }
+    struct csr_file_header header;
+    struct stat st;
+    if (fstat(fd, &st) < 0
+	|| read(fd, &header, sizeof header) != (ssize_t) sizeof header
+	|| memcmp(header.magic, CSR_FILE_MAGIC, sizeof header.magic) != 0) {
+	close(fd);
+	return NULL;
+    }
+    if (header.version != CSR_FILE_VERSION
+	|| header.byte_order != CSR_BYTE_ORDER
+	|| header.word_bytes != sizeof (size_t)) {
+	fprintf(stderr, "%s: unsupported binary graph format\n", path);
+	exit(1);
+    }
+    if (header.vertex_bytes != sizeof (vertex)) {
+	fprintf(stderr, "%s: written with VERTEX_BITS = %d, not %d\n",
+		path, (int) header.vertex_bytes * CHAR_BIT, VERTEX_BITS);
+	exit(1);
+    }
+    size_t size = header.size;
+    size_t offsets_at = sizeof header;
+    size_t name_offsets_at = offsets_at + (size + 1) * sizeof (size_t);
+    size_t active_at = name_offsets_at + size * sizeof (uint64_t);
+    size_t neighbors_at = (active_at + sizeof (struct bitvec)
+			   + bitvec_bytes(size));
+    size_t names_at = neighbors_at + header.num_arcs * sizeof (vertex);
+    if (size > MAX_VERTICES
+	|| header.num_arcs > (uint64_t) st.st_size / sizeof (vertex)
+	|| header.names_bytes > (uint64_t) st.st_size
+	|| (uint64_t) st.st_size != names_at + header.names_bytes) {
+	fprintf(stderr, "%s: truncated or corrupt binary graph\n", path);
+	exit(1);
+    }
+
+    // Private, so that enabling and disabling vertices stays in memory.
+    char *base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE,
+		      MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+	perror(path);
+	exit(1);
+    }
+    struct csr_graph *g = malloc(sizeof *g);
+    g->size = size;
+    g->offsets = (size_t *) (base + offsets_at);
+    g->active = (struct bitvec *) (base + active_at);
+    g->neighbors = (vertex *) (base + neighbors_at);
+    g->mapping = base;
+    g->mapping_size = st.st_size;
+    const uint64_t *name_offsets = (const uint64_t *) (base + name_offsets_at);
+    if (g->offsets[size] != header.num_arcs || g->active->num_bits != size
+	|| !csr_graph_valid(g, name_offsets, base + names_at,
+			    header.names_bytes)) {
+	fprintf(stderr, "%s: corrupt binary graph\n", path);
+	exit(1);
+    }
+    g->matrix = NULL;
+    if (size <= BIT_MATRIX_MAX_SIZE) {
+	g->matrix = bit_matrix_make(size);
+	for (vertex v = 0; v < size; v++) {
+	    vertex w;
+	    CSR_NEIGHBORS_ITER(g, v, w)
+		bit_matrix_set(g->matrix, v, w);
+	}
+    }
+
+    const char **names = malloc(size * sizeof *names);
+    for (vertex v = 0; v < size; v++)
+	names[v] = base + names_at + name_offsets[v];
+    *names_out = names;
+    return g;
+}
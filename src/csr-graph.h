@@ -0,0 +1,121 @@
+#ifndef CSR_GRAPH_H
+#define CSR_GRAPH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "bit-matrix.h"
+#include "bitvec.h"
+#include "graph.h"
+
+/* Immutable graph in compressed sparse row form: the neighbors of v
+   are neighbors[offsets[v]..offsets[v + 1]), all rows in one block.
+   Vertices can still be disabled and enabled, which is recorded in
+   ACTIVE, but edges cannot be added or removed once the graph is
+   built.  */
+struct csr_graph {
+    size_t size;
+    size_t *offsets;		// size + 1 entries
+    vertex *neighbors;
+    struct bitvec *active;
+    struct bit_matrix *matrix;	// for small graphs, else NULL
+    void *mapping;		// file the arrays live in, if any
+    size_t mapping_size;
+};
+
+#define CSR_NEIGHBORS_ITER(g, v, w)					\
+    for (const vertex *__pw = (g)->neighbors + (g)->offsets[v],	\
+	     *__pw_end = (g)->neighbors + (g)->offsets[(v) + 1];	\
+	 __pw != __pw_end && (w = *__pw, 1); __pw++)
+
+#define CSR_ITER_EDGES(g, v, w)					\
+    for (v = 0; v < (g)->size; v++)					\
+	if (csr_graph_vertex_exists(g, v))				\
+	    CSR_NEIGHBORS_ITER(g, v, w)				\
+		if (v < w)
+
+struct csr_graph *csr_graph_make(const struct graph *g);
+struct csr_graph *csr_graph_subgraph(const struct csr_graph *g,
+				     const struct bitvec *s);
+void csr_graph_free(struct csr_graph *g);
+
+/* Orders of the vertices for relabelling them: ORDER[i] becomes
+   vertex i. Neighbors end up close together in the breadth-first and
+   reverse Cuthill-McKee orders; the degree order puts high degree
+   vertices first. In the degeneracy order, every vertex has at most d
+   neighbors before it, for the smallest such d. Nonexistent vertices
+   go last.  */
+enum csr_order {
+    CSR_ORDER_BFS, CSR_ORDER_RCM, CSR_ORDER_DEGREE, CSR_ORDER_DEGENERACY
+};
+vertex *csr_graph_order(const struct csr_graph *g, enum csr_order kind);
+struct csr_graph *csr_graph_permute(const struct csr_graph *g,
+				    const vertex *order);
+struct graph *csr_graph_thaw(const struct csr_graph *g);
+
+/* Binary graph files hold the arrays of a CSR graph as they are laid
+   out in memory, followed by the vertex names, so that they can be
+   mapped without parsing. They are only portable between machines
+   and builds with the same byte order and vertex width.  */
+bool csr_graph_write(const struct csr_graph *g, const char **names,
+		     FILE *stream);
+// Returns NULL if PATH is not a binary graph file.
+struct csr_graph *csr_graph_map(const char *path, const char ***names);
+
+/* Building a graph from scratch: csr_graph_alloc returns SIZE
+   vertices without rows. Count the arcs leaving each vertex with
+   csr_graph_count_arc, call csr_graph_start_rows once, then add
+   exactly the counted arcs with csr_graph_append, row by row in the
+   order they should be iterated.  */
+struct csr_graph *csr_graph_alloc(size_t size);
+void csr_graph_start_rows(struct csr_graph *g);
+
+static inline void csr_graph_count_arc(struct csr_graph *g, vertex v) {
+    g->offsets[v + 1]++;
+}
+
+// offsets[v + 1] is the fill position of row v until it is complete.
+static inline void csr_graph_append(struct csr_graph *g,
+				    vertex v, vertex w) {
+    g->neighbors[g->offsets[v + 1]++] = w;
+    if (g->matrix)
+	bit_matrix_set(g->matrix, v, w);
+}
+
+static inline size_t csr_graph_size(const struct csr_graph *g) {
+    return g->size;
+}
+static inline size_t csr_graph_deg(const struct csr_graph *g, vertex v) {
+    return g->offsets[v + 1] - g->offsets[v];
+}
+size_t csr_graph_num_vertices(const struct csr_graph *g);
+size_t csr_graph_num_edges(const struct csr_graph *g);
+
+static inline bool csr_graph_vertex_exists(const struct csr_graph *g,
+					   vertex v) {
+    return bitvec_get(g->active, v);
+}
+static inline void csr_graph_vertex_enable(struct csr_graph *g, vertex v) {
+    bitvec_set(g->active, v);
+}
+static inline void csr_graph_vertex_disable(struct csr_graph *g, vertex v) {
+    bitvec_unset(g->active, v);
+}
+
+// Hint that the row of v will be scanned soon.
+static inline void csr_graph_prefetch(const struct csr_graph *g, vertex v) {
+#ifdef __GNUC__
+    __builtin_prefetch(g->neighbors + g->offsets[v]);
+#else
+    (void) g; (void) v;
+#endif
+}
+
+/* Two-color the subgraph induced by the existing vertices not in
+   OMIT (which may be NULL).  */
+bool csr_graph_two_coloring(const struct csr_graph *g,
+			    const struct bitvec *omit, struct bitvec *colors);
+bool csr_graph_is_bipartite(const struct csr_graph *g);
+
+#endif // CSR_GRAPH_H
@@ -3,9 +3,10 @@
 #include "bitvec.h"
 #include "edge-flow.h"
 #include "edge-occ.h"
+#include "util.h"
 
 extern bool verbose;
-extern unsigned long long augmentations;
+extern THREAD_LOCAL unsigned long long augmentations;
 
 struct edge_occ *edge_occ_make(size_t capacity) {
     struct edge_occ *occ = malloc(sizeof (struct edge_occ)
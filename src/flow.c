@@ -1,14 +1,33 @@
 #include <stdlib.h>
+#include <string.h>
 
 #include "bitvec.h"
+#include "csr-graph.h"
 #include "flow.h"
 #include "graph.h"
+#include "sparse-set.h"
 #include "util.h"
 
 #define NULL_VERTEX ((vertex) -1)
+
+/* Scratch space for the searches, allocated once per flow so that
+   augmenting along a short path does not pay for the size of the
+   graph. A port has been visited in the current search iff its mark
+   equals the current epoch, so starting a search needs no clearing.  */
+struct flow_workspace {
+    unsigned epoch;
+    unsigned *marks;
+    vertex *predecessors, *successors;
+    vertex *queue, *queue2;
+    struct bitvec *seen, *unseen, *frontier, *next; // for bottom-up steps
+};
+
 struct flow {
-    const struct graph *g;
+    const struct csr_graph *g;
     size_t flow;
+    size_t num_arcs;		// sum of all degrees in g
+    size_t drained;		// path vertices removed by the drain functions
+    struct flow_workspace *ws;
     struct {
 	vertex come_from, go_to;
     } flows[];
@@ -40,19 +59,61 @@ void flow_clear(struct flow *flow) {
     flow->flow = 0;
 }
 
-struct flow* flow_make(const struct graph *g) {
+struct flow* flow_make(const struct csr_graph *g) {
     struct flow* flow = calloc(sizeof (*flow) + g->size * sizeof *flow->flows, 1);
     flow->g = g;
+    for (vertex v = 0; v < g->size; v++)
+	if (csr_graph_vertex_exists(g, v))
+	    flow->num_arcs += csr_graph_deg(g, v);
 
     flow_clear(flow);
 
+    size_t num_codes = 2 * g->size;
+    struct flow_workspace *ws = malloc(sizeof *ws);
+    ws->epoch = 0;
+    ws->marks = calloc(num_codes, sizeof *ws->marks);
+    ws->predecessors = malloc(num_codes * sizeof *ws->predecessors);
+    ws->successors = malloc(num_codes * sizeof *ws->successors);
+    ws->queue = malloc(num_codes * sizeof *ws->queue);
+    ws->queue2 = malloc(num_codes * sizeof *ws->queue2);
+    ws->seen = bitvec_make(num_codes);
+    ws->unseen = bitvec_make(num_codes);
+    ws->frontier = bitvec_make(num_codes);
+    ws->next = bitvec_make(num_codes);
+    flow->ws = ws;
+
     return flow;
 }
 
 void flow_free(struct flow *flow) {
+    struct flow_workspace *ws = flow->ws;
+    free(ws->marks);
+    free(ws->predecessors);
+    free(ws->successors);
+    free(ws->queue);
+    free(ws->queue2);
+    bitvec_free(ws->seen);
+    bitvec_free(ws->unseen);
+    bitvec_free(ws->frontier);
+    bitvec_free(ws->next);
+    free(ws);
     free(flow);
 }
 
+// Start a new search, invalidating all marks. Returns the epoch to
+// mark visited ports with; EPOCHS consecutive values from it are
+// available.
+static inline unsigned ws_new_epoch(struct flow_workspace *ws,
+				    unsigned epochs) {
+    if (ws->epoch > UINT_MAX - epochs) {
+	memset(ws->marks, 0, bitvec_size(ws->seen) * sizeof *ws->marks);
+	ws->epoch = 0;
+    }
+    unsigned epoch = ws->epoch + 1;
+    ws->epoch += epochs;
+    return epoch;
+}
+
 UNUSED static void verify_flow(const struct flow *flow,
 			       const struct bitvec *sources,
 			       const struct bitvec *targets) {
@@ -80,198 +141,399 @@ UNUSED static void verify_flow(const struct flow *flow,
     }
 }
 
-bool flow_augment(struct flow *flow, const struct bitvec *sources,
-		  const struct bitvec *targets) {
-    size_t size = graph_size(flow->g);
-    vertex predecessors[size * 2];
-    bool seen[size * 2];
-    memset(seen, 0, sizeof seen);
-    vertex queue[size * 2];
-    vertex *qhead = queue, *qtail = queue;
-    BITVEC_ITER(sources, v) {
-	if (flow->flows[v].go_to == NULL_VERTEX) {
-	    vertex vcode = (v << 1) | OUT;
-	    predecessors[vcode] = v;
-	    *qtail++ = vcode;
-	    seen[vcode] = true;
+// Reverse one arc (s, s_port) -> (t, !s_port) of an augmenting path
+// in the residual graph.
+static inline void flow_flip_arc(struct flow *flow,
+				 vertex s, port_t s_port, vertex t) {
+    if (s == t) {
+	if (s_port == OUT) {
+	    flow->flows[s].go_to = NULL_VERTEX;
+	    flow->flows[s].come_from = NULL_VERTEX;
 	}
+    } else {
+	if (s_port == OUT) {
+	    flow->flows[t].come_from = s;
+	    flow->flows[s].go_to = t;
+	}
+    }
+}
+
+// Augment along the path ending in port TCODE by following
+// PREDECESSORS back to a start port (whose predecessor is NULL_VERTEX).
+static void flow_flip_path(struct flow *flow, const vertex *predecessors,
+			   vertex tcode) {
+    vertex s;
+    while ((s = predecessors[tcode]) != NULL_VERTEX) {
+	port_t s_port = (tcode & 1) ^ 1;
+	flow_flip_arc(flow, s, s_port, tcode >> 1);
+	tcode = (s << 1) | s_port;
     }
+}
+
+// Direction-optimizing BFS (Beamer et al.): expand top-down from a
+// queue while the frontier is small, and switch to bottom-up search
+// over bit vectors once the arcs leaving the frontier exceed
+// 1/BFS_ALPHA of those left to check from unvisited ports. Switch back
+// when the frontier holds less than 1/BFS_BETA of all ports. Beamer et
+// al. use an alpha of 14; on our instances, a larger frontier is
+// needed before bottom-up steps pay off.
+#define BFS_ALPHA 4
+#define BFS_BETA  24
+
+// Whether the arcs leaving the frontier QHEAD..QTAIL exceed 1/BFS_ALPHA
+// of those left to check from UNSEEN ports, which are assumed to have
+// average degree.
+static inline bool bfs_bottom_up_pays(const struct flow *flow,
+				      const vertex *qhead, const vertex *qtail,
+				      size_t unseen) {
+    size_t frontier_arcs = 0, num_codes = 2 * csr_graph_size(flow->g);
+    for (const vertex *p = qhead; p != qtail; p++)
+	frontier_arcs += ((*p & 1) == OUT
+			  ? csr_graph_deg(flow->g, *p >> 1) : 1);
+    return frontier_arcs * BFS_ALPHA * num_codes > unseen * flow->num_arcs;
+}
+
+/* Breadth-first search in the residual graph of FLOW. The workspace
+   queue holds NUM_SEEDS port codes to start from, which must already
+   be marked with the current epoch and have NULL_VERTEX as
+   predecessor. The predecessor vertex of each visited port is
+   recorded in the workspace. The search stops as soon as it reaches
+   the IN port of a vertex without flow that is in TARGETS (if not
+   NULL) or equal to TARGET, and returns this vertex. Otherwise, all
+   reachable ports are marked and NULL_VERTEX is returned.  */
+static inline vertex flow_bfs(const struct flow *flow, size_t num_seeds,
+			      const struct bitvec *targets, vertex target) {
+    const struct csr_graph *g = flow->g;
+    struct flow_workspace *ws = flow->ws;
+    unsigned *marks = ws->marks, epoch = ws->epoch;
+    vertex *predecessors = ws->predecessors;
+    size_t num_codes = 2 * csr_graph_size(g), num_seen = num_seeds;
+    vertex *qhead = ws->queue, *qtail = ws->queue + num_seeds;
+
+#define IS_TARGET(w) (targets ? bitvec_get(targets, w) : (w) == target)
+#define SEEN(code) (marks[code] == epoch)
+#define VISIT(code, pred, push) do {					\
+	marks[code] = epoch;						\
+	predecessors[code] = pred;					\
+	num_seen++;							\
+	push;								\
+    } while (0)
+#define VISIT_TD(code, pred) VISIT(code, pred, *qtail++ = (code))
+#define VISIT_BU(code, pred) VISIT(code, pred, (bitvec_set(seen, code), \
+						 bitvec_set(next, code), \
+						 frontier_size++))
 
-    vertex target = 0;		/* quench compiler warning */
     while (qhead != qtail) {
-	vertex vcode = *qhead++;
-	port_t port = vcode & 1;
-	vertex v = vcode >>= 1, w;
-
-	if (port == OUT) {
-	    vertex v_go_to = flow->flows[v].go_to;
-	    GRAPH_NEIGHBORS_ITER(flow->g, v, w) {
-		if (!graph_vertex_exists(flow->g, w))
-		    continue;
-		vertex wcode = (w << 1) | IN;
-		if (seen[wcode] || w == v_go_to)
-		    continue;
-
-		predecessors[wcode] = v;
-		*qtail++ = wcode;
-		seen[wcode] = true;
-		    
-		vertex w2code = wcode ^ 1;
-		if (!seen[w2code] && !flow_vertex_flow(flow, w)) {
-		    predecessors[w2code] = w;
-		    if (bitvec_get(targets, w)) {
-			target = w;
-			goto found;
+	size_t frontier_size = qtail - qhead;
+	// Cheap test on the number of ports first.
+	if (frontier_size * BFS_ALPHA > num_codes - num_seen
+	    && bfs_bottom_up_pays(flow, qhead, qtail, num_codes - num_seen)) {
+	    // Bottom-up steps are linear in the graph size anyway, so we
+	    // can afford to turn the marks into a bit vector.
+	    struct bitvec *seen = ws->seen, *frontier = ws->frontier;
+	    struct bitvec *next = ws->next, *unseen = ws->unseen;
+	    bitvec_clear(seen);
+	    for (vertex code = 0; code < num_codes; code++)
+		if (SEEN(code))
+		    bitvec_set(seen, code);
+	    bitvec_clear(frontier);
+	    while (qhead != qtail)
+		bitvec_set(frontier, *qhead++);
+	    qhead = qtail = ws->queue;
+	    do {
+		bitvec_clear(next);
+		frontier_size = 0;
+		// Codes seen during this step are skipped by SEEN.
+		bitvec_copy_invert(unseen, seen);
+		BITVEC_ITER(unseen, code_) {
+		    vertex code = code_, w = code >> 1;
+		    if (SEEN(code) || !csr_graph_vertex_exists(g, w))
+			continue;
+		    vertex pred = NULL_VERTEX, v;
+		    if ((code & 1) == IN) {
+			if (flow_vertex_flow(flow, w)
+			    && bitvec_get(frontier, (w << 1) | OUT)) {
+			    pred = w;
+			} else {
+			    CSR_NEIGHBORS_ITER(g, w, v) {
+				if (bitvec_get(frontier, (v << 1) | OUT)
+				    && flow->flows[v].go_to != w) {
+				    pred = v;
+				    break;
+				}
+			    }
+			}
+			if (pred == NULL_VERTEX)
+			    continue;
+			VISIT_BU(code, pred);
+			if (!SEEN(code ^ 1) && !flow_vertex_flow(flow, w)) {
+			    if (IS_TARGET(w)) {
+				predecessors[code ^ 1] = w;
+				return w;
+			    }
+			    VISIT_BU(code ^ 1, w);
+			}
+		    } else {
+			if (!flow_vertex_flow(flow, w)) {
+			    if (bitvec_get(frontier, code ^ 1))
+				pred = w;
+			} else if ((v = flow->flows[w].go_to) != NULL_VERTEX
+				   && bitvec_get(frontier, (v << 1) | IN)) {
+			    pred = v;
+			}
+			if (pred == NULL_VERTEX)
+			    continue;
+			VISIT_BU(code, pred);
+			if (flow_vertex_flow(flow, w) && !SEEN(code ^ 1))
+			    VISIT_BU(code ^ 1, w);
 		    }
-		    *qtail++ = w2code;
-		    seen[w2code] = true;
 		}
-	    }
-	} else {
-	    w = flow->flows[v].come_from;
-	    if (w != NULL_VERTEX) {
-		vertex wcode = (w << 1) | OUT;
-		if (!seen[wcode]) {
-		    predecessors[wcode] = v;
-		    *qtail++ = wcode;
-		    seen[wcode] = true;
-		    
-		    vertex w2code = wcode ^ 1;
-		    if (!seen[w2code] && flow_vertex_flow(flow, w)) {
-			predecessors[w2code] = w;
-			*qtail++ = w2code;
-			seen[w2code] = true;
+		struct bitvec *tmp = frontier;
+		frontier = next;
+		next = tmp;
+	    } while (frontier_size && frontier_size * BFS_BETA >= num_codes);
+	    BITVEC_ITER(frontier, code)
+		*qtail++ = code;
+	    continue;
+	}
+
+	for (vertex *level_end = qtail; qhead != level_end; ) {
+	    vertex vcode = *qhead++;
+	    // Fetch the next row while this one is scanned.
+	    if (qhead != level_end)
+		csr_graph_prefetch(g, *qhead >> 1);
+	    vertex v = vcode >> 1, w;
+	    if ((vcode & 1) == OUT) {
+		vertex v_go_to = flow->flows[v].go_to;
+		CSR_NEIGHBORS_ITER(g, v, w) {
+		    if (!csr_graph_vertex_exists(g, w))
+			continue;
+		    vertex wcode = (w << 1) | IN;
+		    if (SEEN(wcode) || w == v_go_to)
+			continue;
+		    VISIT_TD(wcode, v);
+		    if (!SEEN(wcode ^ 1) && !flow_vertex_flow(flow, w)) {
+			if (IS_TARGET(w)) {
+			    predecessors[wcode ^ 1] = w;
+			    return w;
+			}
+			VISIT_TD(wcode ^ 1, w);
+		    }
+		}
+	    } else {
+		w = flow->flows[v].come_from;
+		if (w != NULL_VERTEX) {
+		    assert(csr_graph_vertex_exists(g, w));
+		    vertex wcode = (w << 1) | OUT;
+		    if (!SEEN(wcode)) {
+			VISIT_TD(wcode, v);
+			if (!SEEN(wcode ^ 1) && flow_vertex_flow(flow, w))
+			    VISIT_TD(wcode ^ 1, w);
 		    }
 		}
 	    }
 	}
     }
-    return false;
+#undef IS_TARGET
+#undef SEEN
+#undef VISIT
+#undef VISIT_TD
+#undef VISIT_BU
+    return NULL_VERTEX;
+}
 
-found:;    
-    port_t t_port = OUT;
-    vertex t = target;
-    while (1) {
-	vertex s = predecessors[(t << 1) | t_port];
-	port_t s_port = t_port ^ 1;
-
-	if (s == t) {
-	    if (s_port == OUT) {
-		flow->flows[s].go_to = NULL_VERTEX;
-		flow->flows[s].come_from = NULL_VERTEX;
-	    }
-	} else {
-	    if (s_port == OUT) {
-		flow->flows[t].come_from = s;
-		flow->flows[s].go_to = t;
-	    }
-	}
-	if (bitvec_get(sources, s) && s_port == IN) {
-	    flow->flow++;
-	    break;
-	}
-	t = s;
-	t_port = s_port;
-    }
+// Make port CODE a starting point of the current search.
+static inline void ws_seed(struct flow_workspace *ws, vertex code,
+			   size_t *num_seeds) {
+    ws->marks[code] = ws->epoch;
+    ws->predecessors[code] = NULL_VERTEX;
+    ws->queue[(*num_seeds)++] = code;
+}
 
-    return true;    
+bool flow_augment(struct flow *flow, const struct sparse_set *sources,
+		  const struct sparse_set *targets) {
+    struct flow_workspace *ws = flow->ws;
+    size_t num_seeds = 0;
+    vertex v;
+    ws_new_epoch(ws, 1);
+    SPARSE_SET_ITER(sources, v)
+	if (flow->flows[v].go_to == NULL_VERTEX)
+	    ws_seed(ws, (v << 1) | OUT, &num_seeds);
+
+    vertex target = flow_bfs(flow, num_seeds, targets->bits, NULL_VERTEX);
+    if (target == NULL_VERTEX)
+	return false;
+    flow_flip_path(flow, ws->predecessors, (target << 1) | OUT);
+    flow->flow++;
+    return true;
 }
 
 bool flow_augment_pair(struct flow *flow, vertex source, vertex target) {
-    size_t size = graph_size(flow->g);
-    vertex predecessors[size * 2];
-    bool seen[size * 2];
-    memset(seen, 0, sizeof seen);
-    vertex queue[size * 2];
-    vertex *qhead = queue, *qtail = queue;
+    struct flow_workspace *ws = flow->ws;
+    size_t num_seeds = 0;
     //assert(flow->flows[source].go_to == NULL_VERTEX);
-    vertex sourcecode = (source << 1) | OUT;
-    predecessors[sourcecode] = source;
-    *qtail++ = sourcecode;
-    seen[sourcecode] = true;
+    ws_new_epoch(ws, 1);
+    ws_seed(ws, (source << 1) | OUT, &num_seeds);
 
-    while (qhead != qtail) {
-	vertex vcode = *qhead++;
-	port_t port = vcode & 1;
-	vertex v = vcode >>= 1, w;
-
-	if (port == OUT) {
-	    GRAPH_NEIGHBORS_ITER(flow->g, v, w) {
-		if (!graph_vertex_exists(flow->g, w))
-		    continue;
-		vertex wcode = (w << 1) | IN;
-		if (seen[wcode] || w == flow->flows[v].go_to)
-		    continue;
-
-		predecessors[wcode] = v;
-		*qtail++ = wcode;
-		seen[wcode] = true;
-		    
-		vertex w2code = wcode ^ 1;
-		if (!seen[w2code] && !flow_vertex_flow(flow, w)) {
-		    predecessors[w2code] = w;
-		    if (w == target)
-			goto found;
-		    *qtail++ = w2code;
-		    seen[w2code] = true;
+    if (flow_bfs(flow, num_seeds, NULL, target) == NULL_VERTEX)
+	return false;
+    flow_flip_path(flow, ws->predecessors, (target << 1) | OUT);
+    flow->flow++;
+    return true;
+}
+
+// Like flow_augment_pair, but grows BFS trees from both the source
+// (forwards) and the target (backwards in the residual graph), always
+// expanding one full level of the smaller frontier, until they meet.
+bool flow_augment_pair_bidir(struct flow *flow, vertex source, vertex target) {
+    if (flow_vertex_flow(flow, target))
+	return false;
+
+    // Ports seen from the source are marked with fepoch, those seen
+    // from the target with fepoch + 1.
+    struct flow_workspace *ws = flow->ws;
+    unsigned fepoch = ws_new_epoch(ws, 2), bepoch = fepoch + 1;
+    unsigned *marks = ws->marks;
+    vertex *predecessors = ws->predecessors, *successors = ws->successors;
+    vertex *fhead = ws->queue, *ftail = ws->queue;
+    vertex *bhead = ws->queue2, *btail = ws->queue2;
+
+    // Small graphs scan adjacency rows for the ports not seen yet:
+    // the in ports from the source and the out ports from the target.
+    const struct bit_matrix *matrix = flow->g->matrix;
+    const unsigned long *active = flow->g->active->data;
+    size_t words = bitvec_words(flow->g->size);
+    unsigned long fseen[matrix ? words : 1], bseen[matrix ? words : 1];
+    memset(fseen, 0, sizeof fseen);
+    memset(bseen, 0, sizeof bseen);
+
+    vertex sourcecode = (source << 1) | OUT, targetcode = (target << 1) | OUT;
+    predecessors[sourcecode] = NULL_VERTEX;
+    *ftail++ = sourcecode;
+    marks[sourcecode] = fepoch;
+    successors[targetcode] = NULL_VERTEX;
+    *btail++ = targetcode;
+    marks[targetcode] = bepoch;
+
+    vertex meet;
+#define FVISIT(code, pred) do {						\
+	vertex __c = (code);						\
+	if (marks[__c] != fepoch) {					\
+	    predecessors[__c] = (pred);					\
+	    if (marks[__c] == bepoch) {					\
+		meet = __c;						\
+		goto found;						\
+	    }								\
+	    marks[__c] = fepoch;					\
+	    *ftail++ = __c;						\
+	}								\
+    } while (0)
+#define BVISIT(code, succ) do {						\
+	vertex __c = (code);						\
+	if (marks[__c] != bepoch) {					\
+	    successors[__c] = (succ);					\
+	    if (marks[__c] == fepoch) {					\
+		meet = __c;						\
+		goto found;						\
+	    }								\
+	    marks[__c] = bepoch;					\
+	    *btail++ = __c;						\
+	}								\
+    } while (0)
+
+    while (fhead != ftail && bhead != btail) {
+	if (ftail - fhead <= btail - bhead) {
+	    for (vertex *level_end = ftail; fhead != level_end; ) {
+		vertex vcode = *fhead++;
+		if (fhead != level_end)
+		    csr_graph_prefetch(flow->g, *fhead >> 1);
+		vertex v = vcode >> 1, w;
+		if ((vcode & 1) == OUT && matrix) {
+		    vertex v_go_to = flow->flows[v].go_to;
+		    const unsigned long *row = bit_matrix_row(matrix, v);
+		    for (size_t i = 0; i < words; i++)
+			for (unsigned long next = row[i] & active[i] & ~fseen[i];
+			     next; next &= next - 1) {
+			    w = i * BITS_PER_WORD + ctzl(next);
+			    if (w == v_go_to)
+				continue;
+			    fseen[i] |= next & -next;
+			    FVISIT((w << 1) | IN, v);
+			}
+		    if (flow_vertex_flow(flow, v))
+			FVISIT((v << 1) | IN, v);
+		} else if ((vcode & 1) == OUT) {
+		    vertex v_go_to = flow->flows[v].go_to;
+		    CSR_NEIGHBORS_ITER(flow->g, v, w)
+			if (w != v_go_to && csr_graph_vertex_exists(flow->g, w))
+			    FVISIT((w << 1) | IN, v);
+		    if (flow_vertex_flow(flow, v))
+			FVISIT((v << 1) | IN, v);
+		} else {
+		    if (!flow_vertex_flow(flow, v))
+			FVISIT((v << 1) | OUT, v);
+		    else if ((w = flow->flows[v].come_from) != NULL_VERTEX)
+			FVISIT((w << 1) | OUT, v);
 		}
 	    }
 	} else {
-	    w = flow->flows[v].come_from;
-	    if (w != NULL_VERTEX) {
-		assert(graph_vertex_exists(flow->g, w));
-		vertex wcode = (w << 1) | OUT;
-		if (!seen[wcode]) {
-		    predecessors[wcode] = v;
-		    *qtail++ = wcode;
-		    seen[wcode] = true;
-		    
-		    vertex w2code = wcode ^ 1;
-		    if (!seen[w2code] && flow_vertex_flow(flow, w)) {
-			predecessors[w2code] = w;
-			*qtail++ = w2code;
-			seen[w2code] = true;
-		    }
+	    for (vertex *level_end = btail; bhead != level_end; ) {
+		vertex wcode = *bhead++;
+		if (bhead != level_end)
+		    csr_graph_prefetch(flow->g, *bhead >> 1);
+		vertex w = wcode >> 1, v;
+		if ((wcode & 1) == IN && matrix) {
+		    const unsigned long *row = bit_matrix_row(matrix, w);
+		    for (size_t i = 0; i < words; i++)
+			for (unsigned long next = row[i] & active[i] & ~bseen[i];
+			     next; next &= next - 1) {
+			    v = i * BITS_PER_WORD + ctzl(next);
+			    if (flow->flows[v].go_to == w)
+				continue;
+			    bseen[i] |= next & -next;
+			    BVISIT((v << 1) | OUT, w);
+			}
+		    if (flow_vertex_flow(flow, w))
+			BVISIT((w << 1) | OUT, w);
+		} else if ((wcode & 1) == IN) {
+		    CSR_NEIGHBORS_ITER(flow->g, w, v)
+			if (flow->flows[v].go_to != w
+			    && csr_graph_vertex_exists(flow->g, v))
+			    BVISIT((v << 1) | OUT, w);
+		    if (flow_vertex_flow(flow, w))
+			BVISIT((w << 1) | OUT, w);
+		} else {
+		    if (!flow_vertex_flow(flow, w))
+			BVISIT((w << 1) | IN, w);
+		    else if ((v = flow->flows[w].go_to) != NULL_VERTEX)
+			BVISIT((v << 1) | IN, w);
 		}
 	    }
 	}
     }
+#undef FVISIT
+#undef BVISIT
     return false;
 
-found:;    
-    port_t t_port = OUT;
-    vertex t = target;
-    while (1) {
-	vertex s = predecessors[(t << 1) | t_port];
-	port_t s_port = t_port ^ 1;
-
-	if (s == t) {
-	    if (s_port == OUT) {
-		flow->flows[s].go_to = NULL_VERTEX;
-		flow->flows[s].come_from = NULL_VERTEX;
-	    }
-	} else {
-	    if (s_port == OUT) {
-		flow->flows[t].come_from = s;
-		flow->flows[s].go_to = t;
-	    }
-	}
-	if (s == source && s_port == IN) {
-	    flow->flow++;
-	    break;
-	}
-	t = s;
-	t_port = s_port;
+found:;
+    // Arcs of a simple augmenting path can be flipped in any order.
+    flow_flip_path(flow, predecessors, meet);
+    for (vertex scode = meet, t; (t = successors[scode]) != NULL_VERTEX; ) {
+	flow_flip_arc(flow, scode >> 1, scode & 1, t);
+	scode = (t << 1) | ((scode & 1) ^ 1);
     }
+    flow->flow++;
     return true;
 }
 
+
 vertex flow_drain_source(struct flow *flow, vertex source) {
     vertex v = source;
     while (flow->flows[v].go_to != NULL_VERTEX) {
 	vertex succ = flow->flows[v].go_to;
 	flow->flows[v].go_to = NULL_VERTEX;
 	flow->flows[succ].come_from = NULL_VERTEX;
+	flow->drained++;
 	v = succ;
     }
     flow->flow--;
@@ -284,69 +546,48 @@ vertex flow_drain_target(struct flow *flow, vertex target) {
 	vertex pred = flow->flows[v].come_from;
 	flow->flows[v].come_from = NULL_VERTEX;
 	flow->flows[pred].go_to = NULL_VERTEX;
+	flow->drained++;
 	v = pred;
     }
     flow->flow--;
     return v;
 }
 
+size_t flow_drained(const struct flow *flow) {
+    return flow->drained;
+}
+
 struct bitvec *flow_vertex_cut(const struct flow *flow,
-			       const struct bitvec *sources) {
-    size_t size = graph_size(flow->g);
-    assert(bitvec_size(sources) >= size);
-    ALLOCA_BITVEC(enqueued, size * 2);
-    ALLOCA_BITVEC(seen, size);
-    ALLOCA_BITVEC(reached, size);
-    vertex queue[size * 2];
-    vertex *qhead = queue, *qtail = queue;
-
-    for (size_t v = bitvec_find(sources, 0); v != BITVEC_NOT_FOUND;
-	 v = bitvec_find(sources, v + 1)) {
-	bitvec_set(seen, v);
-	if (!flow_vertex_flow(flow, v)) {
-	    vertex vcode = (v << 1) | OUT;
-	    *qtail++ = vcode;
-	    bitvec_set(enqueued, vcode);
-	    bitvec_set(reached, v);
-	}
+			       const struct sparse_set *sources) {
+    size_t size = csr_graph_size(flow->g);
+    assert(bitvec_size(sources->bits) >= size);
+    struct flow_workspace *ws = flow->ws;
+    size_t num_seeds = 0;
+    unsigned epoch = ws_new_epoch(ws, 1);
+
+    struct bitvec *cut = bitvec_make(size);
+    vertex v;
+    SPARSE_SET_ITER(sources, v) {
+	bitvec_set(cut, v);
+	if (!flow_vertex_flow(flow, v))
+	    ws_seed(ws, (v << 1) | OUT, &num_seeds);
     }
 
-    while (qhead != qtail) {
-	vertex vcode = *qhead++;
-	port_t port = vcode & 1;
-	vertex v = vcode >>= 1, w;
-
-	GRAPH_NEIGHBORS_ITER(flow->g, v, w) {
-	    if (!graph_vertex_exists(flow->g, w))
-		continue;
-	    port_t wport = port ^ 1;
-	    vertex wcode = (w << 1) | wport;
-	    if (bitvec_get(enqueued, wcode))
-		continue;
-	    if (port == OUT)
-		bitvec_set(seen, w);
-	    if (port == OUT ? w != flow->flows[v].go_to
-			    : w == flow->flows[v].come_from) {
-		*qtail++ = wcode;
-		bitvec_set(enqueued, wcode);
-		if (wport == OUT)
-		    bitvec_set(reached, w);
-
-		vertex w2code = wcode ^ 1;
-		if (!bitvec_get(enqueued, w2code)
-		    && flow_vertex_flow(flow, w) == (port == IN)) {
-		    *qtail++ = w2code;
-		    bitvec_set(enqueued, w2code);
-		    if (port == OUT)
-			bitvec_set(reached, w);
-		}
-	    }
+    flow_bfs(flow, num_seeds, NULL, NULL_VERTEX);
+
+    // The cut consists of the vertices seen from a reached OUT port
+    // whose own OUT port was not reached.
+    for (vertex v = 0; v < size; v++) {
+	if (ws->marks[(v << 1) | OUT] == epoch) {
+	    vertex w;
+	    CSR_NEIGHBORS_ITER(flow->g, v, w)
+		if (csr_graph_vertex_exists(flow->g, w))
+		    bitvec_set(cut, w);
 	}
     }
-
-    struct bitvec *cut = bitvec_make(size);
-    bitvec_copy(cut, seen);
-    bitvec_setminus(cut, reached);
+    for (vertex v = 0; v < size; v++)
+	if (ws->marks[(v << 1) | OUT] == epoch)
+	    bitvec_unset(cut, v);
     return cut;
 }
 
@@ -5,9 +5,11 @@
 
 #include "graph.h"
 
+struct csr_graph;
 struct flow;
+struct sparse_set;
 
-struct flow* flow_make(const struct graph *g);
+struct flow* flow_make(const struct csr_graph *g);
 void flow_clear(struct flow *flow);
 void flow_free(struct flow *flow);
 
@@ -16,13 +18,15 @@ bool flow_vertex_flow(const struct flow *flow, vertex v);
 bool flow_is_source(const struct flow *flow, vertex v);
 bool flow_is_target(const struct flow *flow, vertex v);
 
-bool flow_augment(struct flow *flow, const struct bitvec *sources,
-		  const struct bitvec *targets);
+bool flow_augment(struct flow *flow, const struct sparse_set *sources,
+		  const struct sparse_set *targets);
 bool flow_augment_pair(struct flow *flow, vertex source, vertex target);
+bool flow_augment_pair_bidir(struct flow *flow, vertex source, vertex target);
 vertex flow_drain_source(struct flow *flow, vertex source);
 vertex flow_drain_target(struct flow *flow, vertex target);
+size_t flow_drained(const struct flow *flow);
 struct bitvec *flow_vertex_cut(const struct flow *flow,
-			       const struct bitvec *sources);
+			       const struct sparse_set *sources);
 void flow_dump(const struct flow *flow);
 
 #endif
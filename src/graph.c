@@ -1,10 +1,13 @@
 #include <ctype.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "util.h"
 #include "bitvec.h"
 #include "graph.h"
+#include "hash-table.h"
+#include "input.h"
 
 size_t graph_num_vertices(const struct graph *g) {
     size_t n = 0;
@@ -24,55 +27,96 @@ size_t graph_num_edges(const struct graph *g) {
     return n / 2;
 }
 
-struct graph *graph_copy(const struct graph *g) {
-    struct graph *g2 = malloc(sizeof (struct graph)
-			      + g->size * sizeof (struct vertex *));
-    g2->capacity = g2->size = g->size;
-    for (size_t i = 0; i < g->size; i++) {
-	if (!graph_vertex_exists(g, i)) {
-	    g2->vertices[i] = NULL_NEIGHBORS;
-	} else {
-	    size_t bytes = (sizeof (struct vertex)
-			    + g->vertices[i]->deg * sizeof (vertex));
-	    g2->vertices[i] = malloc(bytes);
-	    memcpy(g2->vertices[i], g->vertices[i], bytes);
-	}
-    }
-    return g2;
-}
-
 struct graph *graph_grow(struct graph *g, size_t size) {
     if (size > g->capacity) {
 	g = realloc(g, sizeof (struct graph) + size * sizeof (struct vertex *));
 	g->capacity = size;
     }
+    if (size != g->size) {
+	struct bitvec *active = bitvec_make(size);
+	BITVEC_ITER(g->active, v)
+	    bitvec_set(active, v);
+	bitvec_free(g->active);
+	g->active = active;
+    }
     for (size_t i = g->size; i < size; ++i)
-	g->vertices[i] = NULL_NEIGHBORS;
+	g->vertices[i] = NULL;
     g->size = size;
     return g;
 }
 
+/* Rows of arena graphs are carved out of chunks that are only freed
+   together with the graph. A row that outgrows its space moves to a
+   new place in the arena, leaving the old one unused.  */
+struct graph_arena {
+    struct graph_arena *next;	// older chunk
+    size_t used, capacity;	// in vertex units
+    vertex data[];
+};
+
+static vertex *arena_alloc(struct graph_arena **arena, size_t n) {
+    struct graph_arena *chunk = *arena;
+    if (!chunk || chunk->capacity - chunk->used < n) {
+	size_t capacity = chunk ? 2 * chunk->capacity : 0;
+	if (capacity < n)
+	    capacity = n;
+	chunk = malloc(sizeof *chunk + capacity * sizeof (vertex));
+	chunk->next = *arena;
+	chunk->used = 0;
+	chunk->capacity = capacity;
+	*arena = chunk;
+    }
+    vertex *p = chunk->data + chunk->used;
+    chunk->used += n;
+    return p;
+}
+
 void graph_free(struct graph *g) {
-    for (size_t v = 0; v < g->size; v++)
-	if (graph_vertex_exists(g, v))
+    if (g->arena) {
+	for (struct graph_arena *chunk = g->arena, *next; chunk; chunk = next) {
+	    next = chunk->next;
+	    free(chunk);
+	}
+    } else {
+	for (size_t v = 0; v < g->size; v++)
 	    free(g->vertices[v]);
+    }
+    bitvec_free(g->active);
     free(g);
 }
 
-static void grow_neighbors(struct graph *g, vertex v, size_t new_capacity) {
-    bool is_new = !graph_vertex_exists(g, v);
-    if (is_new || new_capacity > g->vertices[v]->capacity) {
-	g->vertices[v] = realloc(graph_vertex_exists(g, v) ? g->vertices[v] : NULL,
-				 sizeof (struct vertex)
-				 + new_capacity * sizeof (vertex));
-	g->vertices[v]->capacity = new_capacity;
+// Make room for at least NEEDED neighbors of v, growing geometrically.
+static void grow_neighbors(struct graph *g, vertex v, size_t needed) {
+    struct vertex *row = g->vertices[v];
+    if (row && needed <= row->capacity)
+	return;
+    size_t capacity = row ? 2 * (size_t) row->capacity : needed;
+    if (capacity < needed)
+	capacity = needed;
+    size_t bytes = sizeof (struct vertex) + capacity * sizeof (vertex);
+    if (g->arena) {
+	struct vertex *new_row = (struct vertex *) arena_alloc(&g->arena,
+							       2 + capacity);
+	if (row)
+	    memcpy(new_row, row, sizeof (struct vertex)
+		   + row->deg * sizeof (vertex));
+	else
+	    new_row->deg = 0;
+	row = new_row;
+    } else {
+	bool is_new = !row;
+	row = realloc(row, bytes);
 	if (is_new)
-	    g->vertices[v]->deg = 0;
-    }    
+	    row->deg = 0;
+    }
+    row->capacity = capacity;
+    g->vertices[v] = row;
 }
 
-static struct vertex *malloc_vertices(size_t n) {
-    struct vertex *result = malloc(sizeof (vertex) * (2 + n));
+static struct vertex *malloc_vertices(struct graph *g, size_t n) {
+    struct vertex *result
+	= (g->arena ? (struct vertex *) arena_alloc(&g->arena, 2 + n)
+	   : malloc(sizeof (vertex) * (2 + n)));
     result->deg = 0;
     result->capacity = n;
     return result;
@@ -82,11 +126,37 @@ struct graph *graph_make(size_t size) {
     struct graph *g = calloc(sizeof (struct graph)
 			     + size * sizeof *g->vertices, 1);
     g->capacity = g->size = size;
-    for (size_t i = 0; i < size; ++i)
-	g->vertices[i] = NULL_NEIGHBORS;
+    g->active = bitvec_make(size);
+    return g;
+}
+
+struct graph *graph_make_arena(size_t size, size_t num_arcs) {
+    struct graph *g = graph_make(size);
+    // Room for the rows of all vertices with NUM_ARCS neighbors in total.
+    arena_alloc(&g->arena, 2 * size + num_arcs);
+    g->arena->used = 0;
     return g;
 }
 
+struct graph *graph_copy(const struct graph *g) {
+    size_t num_arcs = 0;
+    for (size_t i = 0; i < g->size; i++)
+	if (g->vertices[i])
+	    num_arcs += g->vertices[i]->deg;
+    struct graph *g2 = graph_make_arena(g->size, num_arcs);
+    bitvec_copy(g2->active, g->active);
+    for (size_t i = 0; i < g->size; i++) {
+	if (g->vertices[i]) {
+	    size_t bytes = (sizeof (struct vertex)
+			    + g->vertices[i]->deg * sizeof (vertex));
+	    g2->vertices[i] = malloc_vertices(g2, g->vertices[i]->deg);
+	    memcpy(g2->vertices[i], g->vertices[i], bytes);
+	    g2->vertices[i]->capacity = g->vertices[i]->deg;
+	}
+    }
+    return g2;
+}
+
 bool graph_is_connected(const struct graph *g, vertex v, vertex w) {
     assert(v < g->size);
     assert(w < g->size);
@@ -101,13 +171,49 @@ void graph_connect(struct graph *g, vertex v, vertex w) {
     assert(w < g->size);
     assert(v != w);
 
-    grow_neighbors(g, v, graph_vertex_exists(g, v) ? g->vertices[v]->deg + 1 : 1);
-    grow_neighbors(g, w, graph_vertex_exists(g, w) ? g->vertices[w]->deg + 1 : 1);
-    
+    grow_neighbors(g, v, g->vertices[v] ? g->vertices[v]->deg + 1 : 1);
+    grow_neighbors(g, w, g->vertices[w] ? g->vertices[w]->deg + 1 : 1);
+    bitvec_set(g->active, v);
+    bitvec_set(g->active, w);
+
     g->vertices[v]->neighbors[g->vertices[v]->deg++] = w;
     g->vertices[w]->neighbors[g->vertices[w]->deg++] = v;
 }
 
+void graph_set_neighbors(struct graph *g, vertex v,
+			 const vertex *neighbors, size_t deg) {
+    assert(v < g->size);
+    grow_neighbors(g, v, deg);
+    memcpy(g->vertices[v]->neighbors, neighbors, deg * sizeof *neighbors);
+    g->vertices[v]->deg = deg;
+    bitvec_set(g->active, v);
+}
+
+void graph_connect_edges(struct graph *g, size_t num_edges,
+			 const vertex (*edges)[2]) {
+    size_t *added = calloc(g->size, sizeof *added);
+    for (size_t i = 0; i < num_edges; i++) {
+	assert(edges[i][0] < g->size);
+	assert(edges[i][1] < g->size);
+	assert(edges[i][0] != edges[i][1]);
+	added[edges[i][0]]++;
+	added[edges[i][1]]++;
+    }
+    for (vertex v = 0; v < g->size; v++) {
+	if (!added[v])
+	    continue;
+	grow_neighbors(g, v, (g->vertices[v] ? g->vertices[v]->deg : 0)
+		       + added[v]);
+	bitvec_set(g->active, v);
+    }
+    free(added);
+    for (size_t i = 0; i < num_edges; i++) {
+	vertex v = edges[i][0], w = edges[i][1];
+	g->vertices[v]->neighbors[g->vertices[v]->deg++] = w;
+	g->vertices[w]->neighbors[g->vertices[w]->deg++] = v;
+    }
+}
+
 void graph_disconnect(struct graph *g, vertex v, vertex w) {
     assert(v < g->size);
     assert(w < g->size);
@@ -129,27 +235,33 @@ void graph_disconnect(struct graph *g, vertex v, vertex w) {
 }
 
 void graph_vertex_disable(struct graph *g, vertex v) {
-    ((size_t *) g->vertices)[v] |= (size_t) 1;
+    bitvec_unset(g->active, v);
 }
 void graph_vertex_enable(struct graph *g, vertex v) {
-    ((size_t *) g->vertices)[v] &= ~(size_t) 1;
+    if (!g->vertices[v])
+	g->vertices[v] = malloc_vertices(g, 0);
+    bitvec_set(g->active, v);
 }
 
 struct graph *graph_subgraph(const struct graph *g, const struct bitvec *s) {
     size_t size = g->size;
-    struct graph *sub = malloc(sizeof (struct graph) + sizeof (void *) * size);
-    sub->capacity = sub->size = size;
+    size_t num_arcs = 0;
+    for (size_t v = 0; v < size; v++)
+	if (bitvec_get(s, v) && graph_vertex_exists(g, v))
+	    num_arcs += g->vertices[v]->deg;
+    struct graph *sub = graph_make_arena(size, num_arcs);
 
     for (size_t v = 0; v < g->size; v++) {
 	size_t new_deg = 0;
 	if (!bitvec_get(s, v) || !graph_vertex_exists(g, v)) {
-	    sub->vertices[v] = NULL_NEIGHBORS;
+	    sub->vertices[v] = NULL;
 	} else {
+	    bitvec_set(sub->active, v);
 	    for (size_t n = 0; n < g->vertices[v]->deg; n++) {
 		if (bitvec_get(s, g->vertices[v]->neighbors[n]))
 		    new_deg++;
 	    }
-	    sub->vertices[v] = malloc_vertices(new_deg);
+	    sub->vertices[v] = malloc_vertices(sub, new_deg);
 	    for (size_t n = 0; n < g->vertices[v]->deg; n++) {
 		vertex w =g->vertices[v]->neighbors[n];
 		if (bitvec_get(s, w))
@@ -224,21 +336,95 @@ void graph_output(const struct graph *g, FILE *stream, const char **vertices) {
     fprintf(stream, "}\n");
 }
 
-static int pstrcmp(const void *p1, const void *p2) {
-    const char *s1 = *(const char **) p1;
-    const char *s2 = *(const char **) p2;
+// Names are copied into chunks that live as long as the name table.
+static const char *store_name(const char *name) {
+    static char *chunk = NULL;
+    static size_t left = 0;
+    size_t len = strlen(name) + 1;
+    if (len > left) {
+	left = len > 4096 ? len : 4096;
+	chunk = malloc(left);
+    }
+    char *copy = chunk;
+    memcpy(copy, name, len);
+    chunk += len;
+    left -= len;
+    return copy;
+}
+
+static size_t hash_name(const void *p, size_t n) {
+    (void) n;
+    size_t r = 0;
+    for (const unsigned char *s = *(const unsigned char **) p; *s; s++)
+	r = r * 67 + *s - 113;
+    return r;
+}
+
+static bool eq_name(const void *p1, const void *p2, size_t n) {
+    (void) n;
+    return strcmp(*(const char **) p1, *(const char **) p2) == 0;
+}
+
+struct named_vertex { const char *name; vertex v; };
+
+static int cmp_named_vertex(const void *p1, const void *p2) {
+    return strcmp(((const struct named_vertex *) p1)->name,
+		  ((const struct named_vertex *) p2)->name);
+}
+
+struct read_edge { vertex v, w; size_t index; };
+
+// Order by endpoints, then by position in the input.
+static int cmp_read_edge(const void *p1, const void *p2) {
+    const struct read_edge *e1 = p1, *e2 = p2;
+    if (e1->v != e2->v)
+	return e1->v < e2->v ? -1 : 1;
+    if (e1->w != e2->w)
+	return e1->w < e2->w ? -1 : 1;
+    return e1->index < e2->index ? -1 : e1->index > e2->index;
+}
+
+// Build a graph from EDGES (with v < w), which are freed. Duplicates
+// are dropped with a warning; otherwise edges are inserted in order.
+static struct graph *graph_from_edges(size_t size, struct read_edge *edges,
+				      size_t num_edges) {
+    // Sorting brings duplicates together; keep the first of each.
+    qsort(edges, num_edges, sizeof *edges, cmp_read_edge);
+    vertex (*unique)[2] = malloc(num_edges * sizeof *unique);
+    bool *keep = calloc(num_edges, sizeof *keep);
+    for (size_t i = 0; i < num_edges; i++) {
+	if (i > 0 && edges[i].v == edges[i - 1].v && edges[i].w == edges[i - 1].w)
+	    fprintf(stderr, "warning: duplicate edge\n");
+	else
+	    keep[edges[i].index] = true;
+	unique[edges[i].index][0] = edges[i].v;
+	unique[edges[i].index][1] = edges[i].w;
+    }
+    free(edges);
+    size_t num_unique = 0;
+    for (size_t i = 0; i < num_edges; i++)
+	if (keep[i]) {
+	    unique[num_unique][0] = unique[i][0];
+	    unique[num_unique][1] = unique[i][1];
+	    num_unique++;
+	}
+    free(keep);
 
-    return strcmp(s1, s2);
+    struct graph *g = graph_make_arena(size, 2 * num_unique);
+    graph_connect_edges(g, num_unique, (const vertex (*)[2]) unique);
+    free(unique);
+    return g;
 }
 
 struct graph *graph_read(FILE *stream, const char ***vertex_names) {
     size_t line_capacity = 0, line_num = 0;
     char *line = NULL;
     size_t num_names = 0, names_capacity = 16;
-    const char **names = malloc(names_capacity * sizeof *names);
+    struct named_vertex *names = malloc(names_capacity * sizeof *names);
+    struct hash_table *ids = hash_table_make(const char *, vertex,
+					     hash_name, eq_name);
     size_t num_edges = 0, edges_capacity = 64;
-    struct edge { const char *v[2]; } *edges
-	= malloc(edges_capacity * sizeof *edges);
+    struct read_edge *edges = malloc(edges_capacity * sizeof *edges);
 
     while (get_line(&line, &line_capacity, stream)) {
 	line_num++;
@@ -256,52 +442,420 @@ struct graph *graph_read(FILE *stream, const char ***vertex_names) {
             fprintf(stderr, "warning: ignoring trailing garbage on line %zu\n",
 		    line_num);
 
-	// This is O(n^2) or so, but anything better seems like overkill.
+	// Vertices are numbered in order of appearance for now.
+	vertex v[2];
 	for (size_t i = 0; i < 2; i++) {
-	    const char **p;
-	    //fprintf(stderr, "contents:\n");
-	    //for (size_t j = 0; j < num_names; j++)
-	    //	fprintf(stderr, " %s [%zd]\n", names[j], j);
-
-	    if ((p = bsearch(&name[i], names, num_names, sizeof *names,
-			     pstrcmp))) {
-		name[i] = *p;
-		//fprintf(stderr, "found %s [%p]\n", name[i], name[i]);
-	    } else {
-		if (num_names >= names_capacity) {
-		    names_capacity *= 2;
-		    names = realloc(names, names_capacity * sizeof *names);
-		}
-		name[i] = dup_str(name[i]);
-		names[num_names++] = name[i];
-		qsort(names, num_names, sizeof *names, pstrcmp);
-		//fprintf(stderr, "created %s [%p]\n", name[i], name[i]);
+	    const vertex *p = hash_table_get(ids, &name[i]);
+	    if (p) {
+		v[i] = *p;
+		continue;
 	    }
+	    if (num_names >= MAX_VERTICES) {
+		fprintf(stderr, "Too many vertices (at most %zu with"
+			" VERTEX_BITS = %d)\n", MAX_VERTICES, VERTEX_BITS);
+		exit(1);
+	    }
+	    if (num_names >= names_capacity) {
+		names_capacity *= 2;
+		names = realloc(names, names_capacity * sizeof *names);
+	    }
+	    v[i] = num_names;
+	    names[num_names++] = (struct named_vertex) { store_name(name[i]), v[i] };
+	    hash_table_set(ids, &names[v[i]].name, &v[i]);
 	}
 	if (num_edges >= edges_capacity) {
 	    edges_capacity *= 2;
 	    edges = realloc(edges, edges_capacity * sizeof *edges);
 	}
-	edges[num_edges++] = (struct edge) { {name[0], name[1]} };
+	edges[num_edges] = (struct read_edge) {
+	    v[0] < v[1] ? v[0] : v[1], v[0] < v[1] ? v[1] : v[0], num_edges
+	};
+	num_edges++;
     }
+    free(line);
+    hash_table_free(ids);
 
-    struct graph *g = graph_make(num_names);
-    
+    // Renumber the vertices in lexicographic order of their names.
+    qsort(names, num_names, sizeof *names, cmp_named_vertex);
+    vertex *rank = malloc(num_names * sizeof *rank);
+    const char **sorted_names = malloc(num_names * sizeof *sorted_names);
+    for (size_t i = 0; i < num_names; i++) {
+	rank[names[i].v] = i;
+	sorted_names[i] = names[i].name;
+    }
+    free(names);
     for (size_t i = 0; i < num_edges; i++) {
-	vertex v[2];
-	for (size_t j = 0; j < 2; j++) {
-	    const char **p = bsearch(&edges[i].v[j], names, num_names,
-				     sizeof *names, pstrcmp);
-	    v[j] = p - names;
+	vertex v = rank[edges[i].v], w = rank[edges[i].w];
+	edges[i].v = v < w ? v : w;
+	edges[i].w = v < w ? w : v;
+    }
+    free(rank);
+
+    *vertex_names = sorted_names;
+
+    return graph_from_edges(num_names, edges, num_edges);
+}
+
+// Largest vertex number accepted by graph_read_int.
+#define MAX_VERTEX_NUMBER 0x7fffffffUL
+
+// Parse the next vertex number on a line of graph_read_int input.
+// Returns false at the end of the line or at a comment.
+static bool scan_vertex_number(const char **pp, unsigned long *value,
+			       size_t line_num) {
+    const char *p = *pp;
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\f' || *p == '\v')
+	p++;
+    if (*p == '\0' || *p == '#')
+	return false;
+    if (*p < '0' || *p > '9') {
+	fprintf(stderr, "Syntax error on line %zu: expected vertex number\n",
+		line_num);
+	exit(1);
+    }
+    unsigned long n = 0;
+    for (; *p >= '0' && *p <= '9'; p++) {
+	unsigned digit = *p - '0';
+	if (n > (MAX_VERTEX_NUMBER - digit) / 10) {
+	    fprintf(stderr, "Vertex number too large on line %zu\n", line_num);
+	    exit(1);
 	}
-	if (graph_vertex_exists(g, v[0]) && graph_vertex_exists(g, v[1])
-	    && graph_is_connected(g, v[0], v[1]))
-	    fprintf(stderr, "warning: duplicate edge\n");// {%s, %s}\n", names[v[0]], names[v[1]]);
+	n = 10 * n + digit;
+    }
+    *value = n;
+    *pp = p;
+    return true;
+}
+
+static int cmp_number(const void *p1, const void *p2) {
+    unsigned long n1 = *(const unsigned long *) p1;
+    unsigned long n2 = *(const unsigned long *) p2;
+    return n1 < n2 ? -1 : n1 > n2;
+}
+
+// Position of N in the sorted array NUMBERS, which contains it.
+static vertex number_id(const unsigned long *numbers, size_t size,
+			unsigned long n) {
+    size_t lo = 0, hi = size;
+    while (hi - lo > 1) {
+	size_t mid = lo + (hi - lo) / 2;
+	if (numbers[mid] <= n)
+	    lo = mid;
 	else
-	    graph_connect(g, v[0], v[1]);
+	    hi = mid;
     }
-    free(edges);
-    *vertex_names = names;
+    assert(numbers[lo] == n);
+    return lo;
+}
 
-    return g;
+struct graph *graph_read_int(FILE *stream, unsigned long **vertex_numbers) {
+    size_t line_capacity = 0, line_num = 0;
+    char *line = NULL;
+    size_t num_edges = 0, edges_capacity = 64;
+    unsigned long (*numbers)[2] = malloc(edges_capacity * sizeof *numbers);
+
+    while (get_line(&line, &line_capacity, stream)) {
+	line_num++;
+	const char *p = line;
+	unsigned long n[2];
+	if (!scan_vertex_number(&p, &n[0], line_num))
+	    continue;
+	if (!scan_vertex_number(&p, &n[1], line_num)) {
+	    fprintf(stderr, "Syntax error on line %zu\n", line_num);
+	    exit(1);
+	}
+	while (*p && strchr(WHITESPACE, *p))
+	    p++;
+	if (*p && *p != '#')
+	    fprintf(stderr, "warning: ignoring trailing garbage on line %zu\n",
+		    line_num);
+	if (num_edges >= edges_capacity) {
+	    edges_capacity *= 2;
+	    numbers = realloc(numbers, edges_capacity * sizeof *numbers);
+	}
+	numbers[num_edges][0] = n[0];
+	numbers[num_edges][1] = n[1];
+	num_edges++;
+    }
+    free(line);
+
+    /* Vertices are numbered in increasing order of their numbers. The
+       numbers are sorted and deduplicated rather than indexed directly,
+       so that memory does not depend on how large they are.  */
+    unsigned long *numbers_out = malloc(2 * num_edges * sizeof *numbers_out);
+    memcpy(numbers_out, numbers, num_edges * sizeof *numbers);
+    qsort(numbers_out, 2 * num_edges, sizeof *numbers_out, cmp_number);
+    size_t num_vertices = 0;
+    for (size_t i = 0; i < 2 * num_edges; i++)
+	if (i == 0 || numbers_out[i] != numbers_out[num_vertices - 1])
+	    numbers_out[num_vertices++] = numbers_out[i];
+    if (num_vertices > MAX_VERTICES) {
+	fprintf(stderr, "Too many vertices (at most %zu with"
+		" VERTEX_BITS = %d)\n", MAX_VERTICES, VERTEX_BITS);
+	exit(1);
+    }
+    if (num_vertices)
+	numbers_out = realloc(numbers_out, num_vertices * sizeof *numbers_out);
+
+    struct read_edge *edges = malloc(num_edges * sizeof *edges);
+    for (size_t i = 0; i < num_edges; i++) {
+	vertex v = number_id(numbers_out, num_vertices, numbers[i][0]);
+	vertex w = number_id(numbers_out, num_vertices, numbers[i][1]);
+	edges[i] = (struct read_edge) { v < w ? v : w, v < w ? w : v, i };
+    }
+    free(numbers);
+    *vertex_numbers = numbers_out;
+
+    return graph_from_edges(num_vertices, edges, num_edges);
+}
+
+/* Parallel reading of a file: the text is split into one chunk per
+   thread at line boundaries. Each thread tokenizes its lines in place
+   and interns names in a table of its own; the tables are then merged
+   and the edges translated to the final numbering, again in parallel.
+   Names point into the text, which is kept for the lifetime of the
+   program.  */
+struct read_chunk {
+    char *begin, *end;
+    size_t num_lines;
+    struct hash_table *ids;	// name -> local number
+    const char **names;		// by local number
+    size_t num_names, names_capacity;
+    struct read_edge *edges;	// in local numbers
+    size_t num_edges, edges_capacity;
+    size_t *garbage_lines, num_garbage, garbage_capacity;
+    size_t error_line;		// 0 if none
+    bool too_many;		// too many names for a vertex
+    vertex *global;		// local number -> vertex
+    struct read_edge *out;	// where the translated edges go
+    size_t first_edge;
+};
+
+// Cut the next whitespace delimited token out of *P.
+static char *next_token(char **p) {
+    char *s = *p;
+    while (*s && strchr(WHITESPACE, *s))
+	s++;
+    if (!*s)
+	return NULL;
+    char *token = s;
+    while (*s && !strchr(WHITESPACE, *s))
+	s++;
+    if (*s)
+	*s++ = '\0';
+    *p = s;
+    return token;
+}
+
+static vertex chunk_intern(struct read_chunk *c, const char *name) {
+    const vertex *p = hash_table_get(c->ids, &name);
+    if (p)
+	return *p;
+    if (c->num_names >= c->names_capacity) {
+	c->names_capacity *= 2;
+	c->names = realloc(c->names, c->names_capacity * sizeof *c->names);
+    }
+    vertex v = c->num_names;
+    c->names[c->num_names++] = name;
+    hash_table_set(c->ids, &name, &v);
+    return v;
+}
+
+static void *parse_chunk(void *arg) {
+    struct read_chunk *c = arg;
+    c->ids = hash_table_make(const char *, vertex, hash_name, eq_name);
+    c->names_capacity = c->edges_capacity = c->garbage_capacity = 16;
+    c->names = malloc(c->names_capacity * sizeof *c->names);
+    c->edges = malloc(c->edges_capacity * sizeof *c->edges);
+    c->garbage_lines = malloc(c->garbage_capacity * sizeof *c->garbage_lines);
+
+    for (char *line = c->begin; line < c->end; ) {
+	char *eol = memchr(line, '\n', c->end - line);
+	if (!eol)
+	    eol = c->end;
+	*eol = '\0';
+	c->num_lines++;
+	char *p = line;
+	line = eol + 1;
+
+	const char *name[2];
+	name[0] = next_token(&p);
+	if (!name[0] || name[0][0] == '#')
+	    continue;
+	name[1] = next_token(&p);
+	if (!name[1] || name[1][0] == '#') {
+	    c->error_line = c->num_lines;
+	    break;
+	}
+	const char *rest = next_token(&p);
+	if (rest && rest[0] != '#') {
+	    if (c->num_garbage >= c->garbage_capacity) {
+		c->garbage_capacity *= 2;
+		c->garbage_lines = realloc(c->garbage_lines, c->garbage_capacity
+					   * sizeof *c->garbage_lines);
+	    }
+	    c->garbage_lines[c->num_garbage++] = c->num_lines;
+	}
+	if (c->num_names + 2 > MAX_VERTICES) {
+	    c->too_many = true;
+	    break;
+	}
+	vertex v = chunk_intern(c, name[0]), w = chunk_intern(c, name[1]);
+	if (c->num_edges >= c->edges_capacity) {
+	    c->edges_capacity *= 2;
+	    c->edges = realloc(c->edges, c->edges_capacity * sizeof *c->edges);
+	}
+	c->edges[c->num_edges] = (struct read_edge) { v, w, c->num_edges };
+	c->num_edges++;
+    }
+    hash_table_free(c->ids);
+    return NULL;
+}
+
+static void *translate_chunk(void *arg) {
+    struct read_chunk *c = arg;
+    for (size_t i = 0; i < c->num_edges; i++) {
+	vertex v = c->global[c->edges[i].v], w = c->global[c->edges[i].w];
+	c->out[i] = (struct read_edge) {
+	    v < w ? v : w, v < w ? w : v, c->first_edge + i
+	};
+    }
+    return NULL;
+}
+
+// Run FUN on all chunks, each in a thread of its own.
+static void run_chunks(void *(*fun)(void *), struct read_chunk *chunks,
+		       size_t num_chunks) {
+    pthread_t threads[num_chunks];
+    for (size_t i = 1; i < num_chunks; i++)
+	if (pthread_create(&threads[i], NULL, fun, &chunks[i]) != 0) {
+	    perror("pthread_create");
+	    exit(1);
+	}
+    fun(&chunks[0]);
+    for (size_t i = 1; i < num_chunks; i++)
+	pthread_join(threads[i], NULL);
+}
+
+struct graph *graph_read_file(const char *path, size_t num_threads,
+			      const char ***vertex_names) {
+    struct input *input = input_open(path);
+    FILE *stream = input->stream;
+    size_t size = 0, capacity = 1 << 16;
+    char *text = malloc(capacity);
+    size_t n;
+    while ((n = fread(text + size, 1, capacity - size - 1, stream)) > 0) {
+	size += n;
+	if (capacity - size - 1 == 0) {
+	    capacity *= 2;
+	    text = realloc(text, capacity);
+	}
+    }
+    if (ferror(stream)) {
+	perror(path);
+	exit(1);
+    }
+    input_close(input);
+    text[size] = '\0';
+
+    // Small files are not worth the threads.
+    if (num_threads > size / (1 << 16) + 1)
+	num_threads = size / (1 << 16) + 1;
+    if (num_threads < 1)
+	num_threads = 1;
+    struct read_chunk chunks[num_threads];
+    memset(chunks, 0, sizeof chunks);
+    char *begin = text, *end = text + size;
+    for (size_t i = 0; i < num_threads; i++) {
+	char *stop = i + 1 == num_threads ? end : text + size / num_threads * (i + 1);
+	if (stop < begin)
+	    stop = begin;
+	while (stop < end && *stop != '\n')
+	    stop++;
+	if (stop < end)
+	    stop++;
+	chunks[i].begin = begin;
+	chunks[i].end = stop;
+	begin = stop;
+    }
+    run_chunks(parse_chunk, chunks, num_threads);
+
+    // Report problems in the order of the lines.
+    size_t line_offset = 0;
+    for (size_t i = 0; i < num_threads; i++) {
+	for (size_t j = 0; j < chunks[i].num_garbage; j++)
+	    fprintf(stderr, "warning: ignoring trailing garbage on line %zu\n",
+		    line_offset + chunks[i].garbage_lines[j]);
+	if (chunks[i].error_line) {
+	    fprintf(stderr, "Syntax error on line %zu\n",
+		    line_offset + chunks[i].error_line);
+	    exit(1);
+	}
+	if (chunks[i].too_many) {
+	    fprintf(stderr, "Too many vertices (at most %zu with"
+		    " VERTEX_BITS = %d)\n", MAX_VERTICES, VERTEX_BITS);
+	    exit(1);
+	}
+	line_offset += chunks[i].num_lines;
+	free(chunks[i].garbage_lines);
+    }
+
+    // Merge the names, then number the vertices in lexicographic order.
+    struct hash_table *ids = hash_table_make(const char *, vertex,
+					     hash_name, eq_name);
+    size_t num_names = 0, names_capacity = 16, num_edges = 0;
+    struct named_vertex *names = malloc(names_capacity * sizeof *names);
+    for (size_t i = 0; i < num_threads; i++) {
+	struct read_chunk *c = &chunks[i];
+	c->global = malloc(c->num_names * sizeof *c->global);
+	for (size_t j = 0; j < c->num_names; j++) {
+	    const vertex *p = hash_table_get(ids, &c->names[j]);
+	    if (p) {
+		c->global[j] = *p;
+		continue;
+	    }
+	    if (num_names >= MAX_VERTICES) {
+		fprintf(stderr, "Too many vertices (at most %zu with"
+			" VERTEX_BITS = %d)\n", MAX_VERTICES, VERTEX_BITS);
+		exit(1);
+	    }
+	    if (num_names >= names_capacity) {
+		names_capacity *= 2;
+		names = realloc(names, names_capacity * sizeof *names);
+	    }
+	    c->global[j] = num_names;
+	    names[num_names] = (struct named_vertex) { c->names[j], num_names };
+	    hash_table_set(ids, &names[num_names].name, &c->global[j]);
+	    num_names++;
+	}
+	free(c->names);
+	c->first_edge = num_edges;
+	num_edges += c->num_edges;
+    }
+    hash_table_free(ids);
+
+    qsort(names, num_names, sizeof *names, cmp_named_vertex);
+    vertex *rank = malloc(num_names * sizeof *rank);
+    const char **sorted_names = malloc(num_names * sizeof *sorted_names);
+    for (size_t i = 0; i < num_names; i++) {
+	rank[names[i].v] = i;
+	sorted_names[i] = names[i].name;
+    }
+    free(names);
+
+    struct read_edge *edges = malloc(num_edges * sizeof *edges);
+    for (size_t i = 0; i < num_threads; i++) {
+	for (size_t j = 0; j < chunks[i].num_names; j++)
+	    chunks[i].global[j] = rank[chunks[i].global[j]];
+	chunks[i].out = edges + chunks[i].first_edge;
+    }
+    free(rank);
+    run_chunks(translate_chunk, chunks, num_threads);
+    for (size_t i = 0; i < num_threads; i++) {
+	free(chunks[i].global);
+	free(chunks[i].edges);
+    }
+    *vertex_names = sorted_names;
+
+    return graph_from_edges(num_names, edges, num_edges);
 }
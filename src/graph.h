@@ -4,18 +4,41 @@
 #include <assert.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 
-struct bitvec;
+#include "bitvec.h"
 
-/* uint16_t would do, but seems to be slower in benchmarks.  */
-typedef size_t vertex;
+struct graph_arena;
 
-#define NULL_NEIGHBORS ((struct vertex *) (size_t) 1)
+/* Width of vertex numbers, set by the Makefile. Narrower vertices make
+   adjacency and flow arrays smaller; "make bench-width" compares.  */
+#ifndef VERTEX_BITS
+#define VERTEX_BITS 32
+#endif
 
+#if VERTEX_BITS == 16
+typedef uint16_t vertex;
+#elif VERTEX_BITS == 32
+typedef uint32_t vertex;
+#elif VERTEX_BITS == 64
+typedef uint64_t vertex;
+#else
+#error "VERTEX_BITS must be 16, 32 or 64"
+#endif
+
+// The flow on the auxiliary graph of up to twice the size numbers
+// ports as 2 * v + port and needs one value as null marker.
+#define MAX_VERTICES ((size_t) ((vertex) -1 >> 2))
+
+/* Vertices without a row (NULL) do not exist. Disabled vertices keep
+   their row but are cleared in ACTIVE, which is what existence checks
+   look at, so they do not touch the row pointers.  */
 struct graph {
     size_t capacity;
     size_t size;
+    struct bitvec *active;
+    struct graph_arena *arena;	// NULL if rows are malloced one by one
     struct vertex {
 	vertex capacity;
 	vertex deg;
@@ -37,6 +60,9 @@ struct graph {
 
 
 struct graph *graph_make(size_t n);
+// Rows are allocated from an arena, with room for NUM_ARCS neighbors
+// up front, and released all at once by graph_free.
+struct graph *graph_make_arena(size_t n, size_t num_arcs);
 struct graph *graph_copy(const struct graph *g);
 struct graph *graph_grow(struct graph *g, size_t size);
 struct graph *graph_subgraph(const struct graph *g, const struct bitvec *s);
@@ -47,13 +73,19 @@ size_t graph_num_vertices(const struct graph * g);
 size_t graph_num_edges(const struct graph * g);
 static inline bool graph_vertex_exists(const struct graph *g, vertex v) {
     assert(v < g->size);
-    return ((size_t) g->vertices[v] & 1) == 0;
+    return bitvec_get(g->active, v);
 }
 bool graph_is_connected(const struct graph *g, vertex v, vertex w);
 bool graph_is_bipartite(const struct graph *g);
 bool graph_two_coloring(const struct graph *g, struct bitvec *colors);
 
 void graph_connect(struct graph *g, vertex v, vertex w);
+// Set the row of v to DEG NEIGHBORS, without touching their rows.
+void graph_set_neighbors(struct graph *g, vertex v,
+			 const vertex *neighbors, size_t deg);
+// Connect all EDGES in order, growing each row at most once.
+void graph_connect_edges(struct graph *g, size_t num_edges,
+			 const vertex (*edges)[2]);
 void graph_disconnect(struct graph *g, vertex v, vertex w);
 void graph_vertex_disable(struct graph *g, vertex v);
 void graph_vertex_enable(struct graph *g, vertex v);
@@ -66,5 +98,13 @@ static inline void graph_dump(const struct graph *g, const char **vertices) {
     graph_output(g, stderr, vertices);
 }
 struct graph *graph_read(FILE* stream, const char ***vertices_out);
+// Like graph_read, for graphs whose vertex names are all decimal numbers.
+// Vertices are numbered in increasing order of their numbers, which are
+// returned instead of names.
+struct graph *graph_read_int(FILE* stream, unsigned long **numbers_out);
+// Like graph_read, but reads the file PATH using up to NUM_THREADS
+// threads.
+struct graph *graph_read_file(const char *path, size_t num_threads,
+			      const char ***vertices_out);
 
 #endif // GRAPH_H
@@ -0,0 +1,225 @@
+#define _POSIX_C_SOURCE 200809L	// fdopen
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "input.h"
+
+#define BUFFER_SIZE (1 << 16)
+
+enum compression { PLAIN, GZIP, ZSTD };
+
+struct input_feeder {
+    const char *name;
+    FILE *in;			// source
+    int out;			// write end of the pipe
+    enum compression compression;
+    unsigned char head[4];	// bytes read to recognize the format
+    size_t head_size, head_used;
+    pthread_t thread;
+};
+
+static void feeder_error(const struct input_feeder *f, const char *what) {
+    fprintf(stderr, "%s: %s\n", f->name, what);
+    exit(1);
+}
+
+// Read from the source, starting with the bytes already looked at.
+static size_t feeder_read(struct input_feeder *f, void *buf, size_t n) {
+    if (f->head_used < f->head_size) {
+	size_t k = f->head_size - f->head_used;
+	if (k > n)
+	    k = n;
+	memcpy(buf, f->head + f->head_used, k);
+	f->head_used += k;
+	return k;
+    }
+    size_t k = fread(buf, 1, n, f->in);
+    if (k == 0 && ferror(f->in))
+	feeder_error(f, strerror(errno));
+    return k;
+}
+
+static void feeder_write(struct input_feeder *f, const void *buf, size_t n) {
+    const char *p = buf;
+    while (n > 0) {
+	ssize_t k = write(f->out, p, n);
+	if (k < 0 && errno == EINTR)
+	    continue;
+	if (k < 0)
+	    feeder_error(f, strerror(errno));
+	p += k;
+	n -= k;
+    }
+}
+
+static void feed_plain(struct input_feeder *f) {
+    char buf[BUFFER_SIZE];
+    size_t n;
+    while ((n = feeder_read(f, buf, sizeof buf)) > 0)
+	feeder_write(f, buf, n);
+}
+
+#ifdef HAVE_ZLIB
+static void feed_gzip(struct input_feeder *f) {
+    unsigned char in[BUFFER_SIZE], out[BUFFER_SIZE];
+    z_stream z;
+    memset(&z, 0, sizeof z);
+    if (inflateInit2(&z, 15 + 16) != Z_OK)	// gzip header only
+	feeder_error(f, "cannot initialize zlib");
+    int ret = Z_OK;
+    do {
+	z.avail_in = feeder_read(f, in, sizeof in);
+	z.next_in = in;
+	if (z.avail_in == 0)
+	    break;
+	do {
+	    // Concatenated gzip files decompress to the concatenation.
+	    if (ret == Z_STREAM_END)
+		inflateReset(&z);
+	    z.avail_out = sizeof out;
+	    z.next_out = out;
+	    ret = inflate(&z, Z_NO_FLUSH);
+	    if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+		feeder_error(f, z.msg ? z.msg : "corrupt gzip data");
+	    feeder_write(f, out, sizeof out - z.avail_out);
+	} while (z.avail_in > 0 || z.avail_out == 0);
+    } while (true);
+    if (ret != Z_STREAM_END)
+	feeder_error(f, "unexpected end of gzip data");
+    inflateEnd(&z);
+}
+#endif
+
+#ifdef HAVE_ZSTD
+static void feed_zstd(struct input_feeder *f) {
+    size_t in_size = ZSTD_DStreamInSize(), out_size = ZSTD_DStreamOutSize();
+    unsigned char *in = malloc(in_size), *out = malloc(out_size);
+    ZSTD_DStream *zs = ZSTD_createDStream();
+    ZSTD_initDStream(zs);
+    size_t ret = 0, n;
+    while ((n = feeder_read(f, in, in_size)) > 0) {
+	ZSTD_inBuffer input = { in, n, 0 };
+	while (input.pos < input.size) {
+	    ZSTD_outBuffer output = { out, out_size, 0 };
+	    ret = ZSTD_decompressStream(zs, &output, &input);
+	    if (ZSTD_isError(ret))
+		feeder_error(f, ZSTD_getErrorName(ret));
+	    feeder_write(f, out, output.pos);
+	}
+    }
+    // Flush what the decoder still holds back.
+    for (ZSTD_outBuffer output = { out, out_size, out_size };
+	 ret != 0 && output.pos == output.size; ) {
+	ZSTD_inBuffer input = { in, 0, 0 };
+	output.pos = 0;
+	ret = ZSTD_decompressStream(zs, &output, &input);
+	if (ZSTD_isError(ret))
+	    feeder_error(f, ZSTD_getErrorName(ret));
+	feeder_write(f, out, output.pos);
+    }
+    if (ret != 0)
+	feeder_error(f, "unexpected end of zstd data");
+    ZSTD_freeDStream(zs);
+    free(in);
+    free(out);
+}
+#endif
+
+static void *feed(void *arg) {
+    struct input_feeder *f = arg;
+    switch (f->compression) {
+    case PLAIN: feed_plain(f); break;
+#ifdef HAVE_ZLIB
+    case GZIP:	feed_gzip(f); break;
+#endif
+#ifdef HAVE_ZSTD
+    case ZSTD:	feed_zstd(f); break;
+#endif
+    default:	abort();
+    }
+    close(f->out);
+    return NULL;
+}
+
+struct input *input_open(const char *path) {
+    struct input *input = malloc(sizeof *input);
+    FILE *in = path ? fopen(path, "r") : stdin;
+    if (!in) {
+	perror(path);
+	exit(1);
+    }
+    /* Only the first byte of the gzip or zstd magic needs a closer
+       look. Any other byte is put back with ungetc and the input is
+       read directly, whether it is a file or a pipe.  */
+    int c = getc(in);
+    if (c != 0x1f && c != 0x28) {
+	if (c != EOF)
+	    ungetc(c, in);
+	input->stream = in;
+	input->feeder = NULL;
+	return input;
+    }
+
+    struct input_feeder *f = calloc(1, sizeof *f);
+    f->name = path ? path : "standard input";
+    f->in = in;
+    f->head[0] = c;
+    f->head_size = 1 + fread(f->head + 1, 1, sizeof f->head - 1, in);
+
+    static const unsigned char gzip_magic[] = { 0x1f, 0x8b };
+    static const unsigned char zstd_magic[] = { 0x28, 0xb5, 0x2f, 0xfd };
+    if (f->head_size >= sizeof gzip_magic
+	&& memcmp(f->head, gzip_magic, sizeof gzip_magic) == 0)
+	f->compression = GZIP;
+    else if (f->head_size >= sizeof zstd_magic
+	     && memcmp(f->head, zstd_magic, sizeof zstd_magic) == 0)
+	f->compression = ZSTD;
+#ifndef HAVE_ZLIB
+    if (f->compression == GZIP)
+	feeder_error(f, "gzip input needs a build with HAVE_ZLIB");
+#endif
+#ifndef HAVE_ZSTD
+    if (f->compression == ZSTD)
+	feeder_error(f, "zstd input needs a build with HAVE_ZSTD");
+#endif
+    // Plain input that happens to start like a magic number cannot be
+    // put back, so it is copied through the pipe like the rest.
+
+    int fds[2];
+    if (pipe(fds) < 0) {
+	perror("pipe");
+	exit(1);
+    }
+    f->out = fds[1];
+    input->stream = fdopen(fds[0], "r");
+    input->feeder = f;
+    if (pthread_create(&f->thread, NULL, feed, f) != 0) {
+	perror("pthread_create");
+	exit(1);
+    }
+    return input;
+}
+
+void input_close(struct input *input) {
+    struct input_feeder *f = input->feeder;
+    if (f) {
+	pthread_join(f->thread, NULL);
+	if (f->in != stdin)
+	    fclose(f->in);
+	free(f);
+    }
+    if (input->stream != stdin)
+	fclose(input->stream);
+    free(input);
+}
@@ -0,0 +1,20 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdio.h>
+
+struct input_feeder;
+
+/* An input stream for reading a graph. Input compressed with gzip or
+   zstd (recognized by the magic bytes) is decompressed by a separate
+   thread into a pipe, so that decompression overlaps with parsing.  */
+struct input {
+    FILE *stream;
+    struct input_feeder *feeder;	// NULL if STREAM is read directly
+};
+
+// Open PATH, or standard input if PATH is NULL. Exits on errors.
+struct input *input_open(const char *path);
+void input_close(struct input *input);
+
+#endif	// INPUT_H
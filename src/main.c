@@ -1,19 +1,25 @@
 #include <assert.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #if defined (__SVR4) && defined (__sun)
 int getopt(int argc, const char *argv[], const char *optstring);
 #else
 #include <getopt.h>
 #endif
+#include <pthread.h>
 #include <unistd.h>
 #include <sys/times.h>
 
 #include "bitvec.h"
+#include "csr-graph.h"
 #include "edge-occ.h"
 #include "graph.h"
+#include "input.h"
 #include "occ.h"
+#include "util.h"
 
 double user_time(void) {
     struct tms buf;
@@ -24,10 +30,30 @@ double user_time(void) {
 void usage(FILE *stream) {
     fprintf(stream,
 	    "occ: Calculate minimum odd cycle cover\n"
+	    "Usage: occ [OPTION]... [FILE]  (reads standard input without FILE)\n"
+	    "FILE may be compressed with gzip or zstd.\n"
 	    "  -e  Cover edges instead of vertices\n"
 	    "  -d  Start with a random heuristic OCC and shrink it succesively\n"
 	    "  -b  Enumerate valid partitions only for bipartite subgraphs\n"
 	    "  -g  Enumerate valid partitions by gray code\n"
+	    "  -n  Vertex names are numbers (faster reading)\n"
+	    "  -j N  Read FILE with N threads (default: number of CPUs)\n"
+	    "  -w OUT  Write the graph to OUT in binary format and exit\n"
+	    "  -r ORDER  Renumber vertices for memory locality after reading:\n"
+	    "            bfs, rcm (reverse Cuthill-McKee), degree or degeneracy\n"
+	    "  -i ORDER  Add vertices in ORDER when compressing upwards: one\n"
+	    "            of the -r orders, heuristic (heuristic OCC last) or\n"
+	    "            number (default)\n"
+	    "  -p N  Compress up to N upward steps ahead in parallel,\n"
+	    "        assuming that the earlier ones fail to shrink\n"
+	    "  -B N  Add up to N vertices per upward step (not with -p)\n"
+	    "  -c ORDER  Branch with -b on the first grey vertex (first,\n"
+	    "            default), the one of highest degree in G[occ]\n"
+	    "            (degree), with most colored neighbors (colored), or\n"
+	    "            whose augmentation failed most often (failures)\n"
+	    "  -o ORDER  Order the cover vertices for -g, cheapest first, by\n"
+	    "            number (default), degree, or drain (by the flow paths\n"
+	    "            drained in earlier steps of the same thread)\n"
 	    "  -v  Print progress to stderr\n"
 	    "  -s  Print only statistics\n"
 	    "  -h  Display this list of options\n"
@@ -40,22 +66,306 @@ bool downwards	= false;
 bool enum2col   = false;
 bool use_gray   = false;
 bool stats_only = false;
-unsigned long long augmentations = 0;
+bool int_names  = false;
+long read_threads = 0;
+const char *binary_out = NULL;
+const char *relabel = NULL;
+const char *insert = NULL;
+enum occ_order gray_order = OCC_ORDER_NUMBER;
+enum occ_branch branch_order = OCC_BRANCH_FIRST;
+THREAD_LOCAL unsigned long long augmentations = 0;
+THREAD_LOCAL unsigned long long search_nodes = 0; // enum2col branch calls
+size_t peak_occ_size = 0;	// largest intermediate solution
+// Bounds for -j and -p, and for -B.
+#define MAX_THREADS 1024
+#define MAX_BATCH (1L << 20)
+size_t speculation = 0;
+size_t max_batch = 1;
+size_t speculation_hits = 0, speculation_misses = 0;
 
-struct bitvec *find_occ(const struct graph *g) {
+// The best of several heuristic solutions.
+static struct bitvec *best_heuristic(const struct csr_graph *g) {
+    struct bitvec *occ = occ_heuristic(g);
+    for (size_t i = 0; i < 100; i++) {
+	struct bitvec *occ2 = occ_heuristic(g);
+	if (bitvec_count(occ2) < bitvec_count(occ)) {
+	    free(occ);
+	    occ = occ2;
+	} else {
+	    free(occ2);
+	}
+    }
+    return occ;
+}
+
+/* An upward step that has to compress: OCC, which includes the vertex
+   just added, covers G, the subgraph of the vertices added so far.
+   With speculation, it may run while earlier steps are still being
+   compressed, on the assumption that they fail.  */
+enum step_state {STEP_FREE, STEP_QUEUED, STEP_DONE};
+
+struct upward_step {
+    size_t index;		// position of the vertex in the insertion order
+    vertex added;		// that vertex
+    struct csr_graph *g;
+    struct bitvec *occ;
+    struct bitvec *result;	// smaller cover, or NULL
+    unsigned long long augmentations, search_nodes;
+    bool speculative;
+    bool cancel;		// accessed with __atomic builtins
+    enum step_state state;	// protected by the pool lock
+};
+
+/* Each slot of the step queue is served by a worker thread of its
+   own, which sleeps while the slot is free, so that no thread is
+   created per step.  */
+struct step_pool {
+    pthread_mutex_t lock;
+    pthread_cond_t queued, done;
+    bool quit;
+};
+
+struct upward_worker {
+    struct step_pool *pool;
+    struct upward_step *step;	// the slot it serves
+    pthread_t thread;
+};
+
+static void run_upward_step(struct upward_step *step) {
+    // The counters are per thread and keep counting across steps.
+    unsigned long long augmentations_before = augmentations;
+    unsigned long long search_nodes_before = search_nodes;
+    step->result = occ_shrink_until(step->g, step->occ, enum2col, use_gray,
+				    step->added, &step->cancel);
+    step->augmentations = augmentations - augmentations_before;
+    step->search_nodes = search_nodes - search_nodes_before;
+    occ_forget_stats();
+}
+
+static void *upward_worker(void *arg) {
+    struct upward_worker *w = arg;
+    struct step_pool *pool = w->pool;
+    pthread_mutex_lock(&pool->lock);
+    while (true) {
+	while (w->step->state != STEP_QUEUED && !pool->quit)
+	    pthread_cond_wait(&pool->queued, &pool->lock);
+	if (w->step->state != STEP_QUEUED)
+	    break;
+	pthread_mutex_unlock(&pool->lock);
+	run_upward_step(w->step);
+	pthread_mutex_lock(&pool->lock);
+	w->step->state = STEP_DONE;
+	pthread_cond_broadcast(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+static void queue_step(struct step_pool *pool, struct upward_step *step,
+		       struct upward_step init) {
+    pthread_mutex_lock(&pool->lock);
+    *step = init;
+    step->state = STEP_QUEUED;
+    pthread_cond_broadcast(&pool->queued);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static void wait_step(struct step_pool *pool, struct upward_step *step) {
+    pthread_mutex_lock(&pool->lock);
+    while (step->state != STEP_DONE)
+	pthread_cond_wait(&pool->done, &pool->lock);
+    step->state = STEP_FREE;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static void free_upward_step(struct upward_step *step) {
+    csr_graph_free(step->g);
+    bitvec_free(step->occ);
+}
+
+/* Upward compression with up to SPECULATION steps running ahead of
+   the oldest unfinished one. When a step does find a smaller cover,
+   the steps after it are cancelled and redone from there, so the
+   result is the same as without speculation.  */
+static struct bitvec *find_occ_speculative(const struct csr_graph *g,
+					   const vertex *insertion) {
+    struct bitvec *occ = bitvec_make(g->size);
+    // The cover assumed by the next step, i.e. if all queued steps fail.
+    struct bitvec *next_occ = bitvec_make(g->size);
+    ALLOCA_BITVEC(sub, g->size);
+    size_t capacity = speculation + 1, head = 0, num_steps = 0, next = 0;
+    struct upward_step *steps = calloc(capacity, sizeof *steps);
+    struct step_pool pool = {
+	PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+	PTHREAD_COND_INITIALIZER, false
+    };
+    struct upward_worker *workers = malloc(capacity * sizeof *workers);
+    for (size_t i = 0; i < capacity; i++) {
+	workers[i] = (struct upward_worker) { .pool = &pool, .step = &steps[i] };
+	if (pthread_create(&workers[i].thread, NULL, upward_worker,
+			   &workers[i])) {
+	    perror("pthread_create");
+	    exit(1);
+	}
+    }
+
+    while (true) {
+	while (num_steps < capacity && next < g->size) {
+	    vertex v = insertion ? insertion[next] : next;
+	    bitvec_set(sub, v);
+	    struct csr_graph *g2 = csr_graph_subgraph(g, sub);
+	    if (occ_is_occ(g2, next_occ)) {
+		csr_graph_free(g2);
+		next++;
+		continue;
+	    }
+	    bitvec_set(next_occ, v);
+	    struct upward_step *step = &steps[(head + num_steps) % capacity];
+	    queue_step(&pool, step, (struct upward_step) {
+		.index = next++,
+		.added = v,
+		.g = g2,
+		.occ = bitvec_clone(next_occ),
+		.speculative = num_steps > 0,
+	    });
+	    num_steps++;
+	}
+	if (num_steps == 0)
+	    break;
+
+	struct upward_step *step = &steps[head];
+	wait_step(&pool, step);
+	head = (head + 1) % capacity;
+	num_steps--;
+	augmentations += step->augmentations;
+	search_nodes += step->search_nodes;
+	if (step->speculative)
+	    speculation_hits++;
+	if (bitvec_count(step->occ) > peak_occ_size)
+	    peak_occ_size = bitvec_count(step->occ);
+	if (verbose) {
+	    fprintf(stderr, "size = %3zd ", csr_graph_num_vertices(step->g));
+	    fprintf(stderr, "occ = ");
+	    bitvec_dump(step->occ);
+	    putc('\n', stderr);
+	}
+	if (!step->result) {
+	    bitvec_copy(occ, step->occ);
+	    free_upward_step(step);
+	    continue;
+	}
+
+	// The later steps assumed that this one fails.
+	for (size_t i = 0; i < num_steps; i++)
+	    __atomic_store_n(&steps[(head + i) % capacity].cancel, true,
+			     __ATOMIC_RELAXED);
+	for (size_t i = 0; i < num_steps; i++) {
+	    struct upward_step *later = &steps[(head + i) % capacity];
+	    wait_step(&pool, later);
+	    free_upward_step(later);
+	    speculation_misses++;
+	}
+	num_steps = 0;
+	free(occ);
+	occ = step->result;
+	if (!occ_is_occ(step->g, occ)) {
+	    fprintf(stderr, "Internal error!\n");
+	    assert(0);
+	}
+	for (size_t j = step->index + 1; j < next; j++)
+	    bitvec_unset(sub, insertion ? insertion[j] : j);
+	next = step->index + 1;
+	bitvec_copy(next_occ, occ);
+	free_upward_step(step);
+    }
+    pthread_mutex_lock(&pool.lock);
+    pool.quit = true;
+    pthread_cond_broadcast(&pool.queued);
+    pthread_mutex_unlock(&pool.lock);
+    for (size_t i = 0; i < capacity; i++)
+	pthread_join(workers[i].thread, NULL);
+    free(workers);
+    free(steps);
+    bitvec_free(next_occ);
+    return occ;
+}
+
+/* Upward compression testing up to MAX_BATCH vertices per step. When
+   the cover still works for the graph with all of them added, they are
+   done with a single test. When it does not, the step is redone with
+   just the first of them and compressed as in find_occ, where the new
+   vertex is known to stay out of a smaller cover; compressing a batch
+   would lose that and cost several enumerations. Batches start at one
+   vertex and only double after BATCH_GROW_STEPS steps in a row have
+   not needed to compress, so graphs where most steps compress pay next
+   to nothing for the failed batches.  */
+#define BATCH_GROW_STEPS 8
+
+static struct bitvec *find_occ_batched(const struct csr_graph *g,
+				       const vertex *insertion) {
+    struct bitvec *occ = bitvec_make(g->size);
+    ALLOCA_BITVEC(sub, g->size);
+    size_t batch = 1, num_steps = 0, num_compressed = 0, quiet_steps = 0;
+
+    for (size_t j = 0; j < g->size; num_steps++) {
+	size_t end = j + batch < g->size ? j + batch : g->size;
+	for (size_t i = j; i < end; i++)
+	    bitvec_set(sub, insertion ? insertion[i] : i);
+	struct csr_graph *g2 = csr_graph_subgraph(g, sub);
+	if (occ_is_occ(g2, occ)) {
+	    csr_graph_free(g2);
+	    j = end;
+	    if (++quiet_steps >= BATCH_GROW_STEPS && batch < max_batch) {
+		batch = 2 * batch < max_batch ? 2 * batch : max_batch;
+		quiet_steps = 0;
+	    }
+	    continue;
+	}
+	quiet_steps = 0;
+	if (end - j > 1) {
+	    csr_graph_free(g2);
+	    for (size_t i = j + 1; i < end; i++)
+		bitvec_unset(sub, insertion ? insertion[i] : i);
+	    batch = 1;
+	    continue;
+	}
+	num_compressed++;
+	vertex v = insertion ? insertion[j] : j;
+	bitvec_set(occ, v);
+	if (bitvec_count(occ) > peak_occ_size)
+	    peak_occ_size = bitvec_count(occ);
+	if (verbose) {
+	    fprintf(stderr, "size = %3zd ", csr_graph_num_vertices(g2));
+	    fprintf(stderr, "occ = ");
+	    bitvec_dump(occ);
+	    putc('\n', stderr);
+	}
+	struct bitvec *occ_new = occ_shrink(g2, occ, enum2col, use_gray, v);
+	if (occ_new) {
+	    free(occ);
+	    occ = occ_new;
+	}
+	if (!occ_is_occ(g2, occ)) {
+	    fprintf(stderr, "Internal error!\n");
+	    assert(0);
+	}
+	csr_graph_free(g2);
+	j = end;
+    }
+    if (verbose)
+	fprintf(stderr, "%zu steps, %zu compressed\n",
+		num_steps, num_compressed);
+    return occ;
+}
+
+/* Upward compression adds the vertices in INSERTION order, or by
+   number if INSERTION is NULL.  */
+struct bitvec *find_occ(const struct csr_graph *g, const vertex *insertion) {
     struct bitvec *occ = NULL;
     
     if (downwards) {
-	occ = occ_heuristic(g);
-	for (size_t i = 0; i < 100; i++) {
-	    struct bitvec *occ2 = occ_heuristic(g);
-	    if (bitvec_count(occ2) < bitvec_count(occ)) {
-		free(occ);
-		occ = occ2;
-	    } else {
-		free(occ2);
-	    }
-	}
+	occ = best_heuristic(g);
+	peak_occ_size = bitvec_count(occ);
 	struct bitvec *occ_new;
 	while (true) {
 	    if (verbose) {
@@ -63,32 +373,41 @@ struct bitvec *find_occ(const struct graph *g) {
 		bitvec_dump(occ);
 		putc('\n', stderr);
 	    }
-	    occ_new = occ_shrink(g, occ, enum2col, use_gray, false);
+	    occ_new = occ_shrink(g, occ, enum2col, use_gray, OCC_NO_LAST);
 	    if (!occ_new || bitvec_count(occ_new) == bitvec_count(occ))
 		break;
 	    free(occ);
 	    occ = occ_new;
 	}
+    } else if (speculation > 0) {
+	occ = find_occ_speculative(g, insertion);
+    } else if (max_batch > 1) {
+	occ = find_occ_batched(g, insertion);
     } else {
 	occ = bitvec_make(g->size);
 	ALLOCA_BITVEC(sub, g->size);
 
-	for (size_t i = 0; i < g->size; i++) {
+	for (size_t j = 0; j < g->size; j++) {
+	    vertex i = insertion ? insertion[j] : j;
 	    bitvec_set(sub, i);
-	    struct graph *g2 = graph_subgraph(g, sub);
+	    struct csr_graph *g2 = csr_graph_subgraph(g, sub);
 	    if (occ_is_occ(g2, occ)) {
-		graph_free(g2);
+		csr_graph_free(g2);
 		continue;
 	    }
 	    bitvec_set(occ, i);
+	    if (bitvec_count(occ) > peak_occ_size)
+		peak_occ_size = bitvec_count(occ);
 	    if (verbose) {
-		fprintf(stderr, "size = %3zd ", graph_num_vertices(g2));
+		fprintf(stderr, "size = %3zd ", csr_graph_num_vertices(g2));
 		fprintf(stderr, "occ = ");
 		bitvec_dump(occ);
 		putc('\n', stderr);
 	    }
+	    // The vertex just added is not in a smaller cover, or the
+	    // previous cover would not have been minimal.
 	    struct bitvec *occ_new = occ_shrink(g2, occ, enum2col,
-						use_gray, true);
+						use_gray, i);
 	    if (occ_new) {
 		free(occ);
 		occ = occ_new;
@@ -97,7 +416,7 @@ struct bitvec *find_occ(const struct graph *g) {
 		    assert(0);
 		}
 	    }
-	    graph_free(g2);
+	    csr_graph_free(g2);
 	}
     }
     return occ;
@@ -123,6 +442,8 @@ struct edge_occ *find_edge_occ(const struct graph *g) {
 		}
 	    }
 	    assert(edge_occ_is_occ(g, occ));
+	    if (occ->size > peak_occ_size)
+		peak_occ_size = occ->size;
 	    if (verbose) {
 		fprintf(stderr, "size = %3zd ", graph_num_edges(g));
 		fprintf(stderr, "occ = "); edge_occ_dump(occ);
@@ -137,7 +458,7 @@ struct edge_occ *find_edge_occ(const struct graph *g) {
     } else {
 	occ = edge_occ_make(0);
 	vertex v, w;
-	struct graph *g2 = graph_make(g->size);
+	struct graph *g2 = graph_make_arena(g->size, 2 * graph_num_edges(g));
 	GRAPH_ITER_EDGES(g, v, w) {
 	    graph_connect(g2, v, w);
 	    if (edge_occ_is_occ(g2, occ))
@@ -145,6 +466,8 @@ struct edge_occ *find_edge_occ(const struct graph *g) {
 	    occ = realloc(occ, sizeof (struct edge_occ)
 			  + (occ->size + 1) * sizeof *occ->edges);
 	    occ->edges[occ->size++] = (struct edge) { v, w };
+	    if (occ->size > peak_occ_size)
+		peak_occ_size = occ->size;
 	    assert(edge_occ_is_occ(g2, occ));
 	    if (verbose) {
 		fprintf(stderr, "size = %3zd ", graph_num_edges(g2));
@@ -162,14 +485,127 @@ struct edge_occ *find_edge_occ(const struct graph *g) {
     return occ;
 }
 
+// Print the name of V as read by graph_read or graph_read_int.
+static void print_vertex(vertex v, const char **vertices,
+			 const unsigned long *numbers, char end) {
+    if (numbers)
+	printf("%lu%c", numbers[v], end);
+    else
+	printf("%s%c", vertices[v], end);
+}
+
+static bool parse_order(const char *name, enum csr_order *order) {
+    static const struct {
+	const char *name;
+	enum csr_order order;
+    } orders[] = {
+	{ "bfs", CSR_ORDER_BFS },
+	{ "rcm", CSR_ORDER_RCM },
+	{ "degree", CSR_ORDER_DEGREE },
+	{ "degeneracy", CSR_ORDER_DEGENERACY },
+    };
+    for (size_t i = 0; i < sizeof orders / sizeof *orders; i++)
+	if (strcmp(name, orders[i].name) == 0) {
+	    *order = orders[i].order;
+	    return true;
+	}
+    return false;
+}
+
+// Parse a count between MIN and MAX for an option, or exit.
+static long parse_count(const char *arg, long min, long max) {
+    char *end;
+    errno = 0;
+    long n = strtol(arg, &end, 10);
+    if (errno || end == arg || *end || n < min || n > max) {
+	usage(stderr);
+	exit(1);
+    }
+    return n;
+}
+
+static enum occ_order parse_gray_order(const char *name) {
+    if (strcmp(name, "number") == 0)
+	return OCC_ORDER_NUMBER;
+    if (strcmp(name, "degree") == 0)
+	return OCC_ORDER_DEGREE;
+    if (strcmp(name, "drain") == 0)
+	return OCC_ORDER_DRAIN;
+    usage(stderr);
+    exit(1);
+}
+
+static enum occ_branch parse_branch_order(const char *name) {
+    if (strcmp(name, "first") == 0)
+	return OCC_BRANCH_FIRST;
+    if (strcmp(name, "degree") == 0)
+	return OCC_BRANCH_DEGREE;
+    if (strcmp(name, "colored") == 0)
+	return OCC_BRANCH_COLORED;
+    if (strcmp(name, "failures") == 0)
+	return OCC_BRANCH_FAILURES;
+    usage(stderr);
+    exit(1);
+}
+
+// Reorder the vertex names to match a relabelled graph.
+static void permute_names(const vertex *order, size_t size,
+			  const char ***vertices, unsigned long **numbers) {
+    if (*numbers) {
+	unsigned long *p = malloc(size * sizeof *p);
+	for (size_t v = 0; v < size; v++)
+	    p[v] = (*numbers)[order[v]];
+	*numbers = p;
+    } else {
+	const char **p = malloc(size * sizeof *p);
+	for (size_t v = 0; v < size; v++)
+	    p[v] = (*vertices)[order[v]];
+	*vertices = p;
+    }
+}
+
+// Write the graph read to BINARY_OUT.
+static bool write_binary(const struct graph *g, const struct csr_graph *csr,
+			 const char **vertices, const unsigned long *numbers) {
+    struct csr_graph *frozen = csr ? NULL : csr_graph_make(g);
+    if (!csr)
+	csr = frozen;
+    if (numbers) {
+	char **names = malloc(csr->size * sizeof *names);
+	for (size_t v = 0; v < csr->size; v++) {
+	    names[v] = malloc(3 * sizeof numbers[v] + 1);
+	    sprintf(names[v], "%lu", numbers[v]);
+	}
+	vertices = (const char **) names;
+    }
+    FILE *stream = fopen(binary_out, "wb");
+    if (!stream || !csr_graph_write(csr, vertices, stream)
+	|| fclose(stream) != 0) {
+	perror(binary_out);
+	return false;
+    }
+    if (frozen)
+	csr_graph_free(frozen);
+    return true;
+}
+
 int main(int argc, char *argv[]) {
     int c;
-    while ((c = getopt(argc, argv, "edbgvsh")) != -1) {
+    while ((c = getopt(argc, argv, "edbgnj:w:r:i:p:B:o:c:vsh")) != -1) {
 	switch (c) {
 	case 'e': edge_occ   = true; break;
 	case 'd': downwards  = true; break;
 	case 'b': enum2col   = true; break;
 	case 'g': use_gray   = true; break;
+	case 'n': int_names  = true; break;
+	case 'j': read_threads = parse_count(optarg, 0, MAX_THREADS); break;
+	case 'w': binary_out = optarg; break;
+	case 'r': relabel    = optarg; break;
+	case 'i': insert     = optarg; break;
+	case 'p': speculation = parse_count(optarg, 0, MAX_THREADS); break;
+	case 'B': max_batch  = parse_count(optarg, 1, MAX_BATCH); break;
+	case 'o': gray_order = parse_gray_order(optarg); break;
+	case 'c': branch_order = parse_branch_order(optarg); break;
 	case 'v': verbose    = true; break;
 	case 's': stats_only = true; break;
 	case 'h': usage(stdout); exit(0); break;
@@ -177,30 +613,127 @@ int main(int argc, char *argv[]) {
 	}
     }
 
-    const char **vertices;
-    struct graph *g = graph_read(stdin, &vertices);
+    if (optind + 1 < argc) {
+	usage(stderr);
+	exit(1);
+    }
+    if (speculation > 0 && max_batch > 1) {
+	fprintf(stderr, "-p and -B cannot be combined\n");
+	exit(1);
+    }
+    enum csr_order relabel_order = CSR_ORDER_BFS, insert_order = CSR_ORDER_BFS;
+    if ((relabel && !parse_order(relabel, &relabel_order))
+	|| (insert && strcmp(insert, "number") != 0
+	    && strcmp(insert, "heuristic") != 0
+	    && !parse_order(insert, &insert_order))) {
+	usage(stderr);
+	exit(1);
+    }
+    const char **vertices = NULL;
+    unsigned long *numbers = NULL;
+    struct graph *g = NULL;
+    struct csr_graph *csr = NULL;
+    if (optind < argc && (csr = csr_graph_map(argv[optind], &vertices))) {
+	// Binary graph, nothing to parse.
+    } else if (optind == argc || int_names) {
+	struct input *input = input_open(optind < argc ? argv[optind] : NULL);
+	g = (int_names ? graph_read_int(input->stream, &numbers)
+	     : graph_read(input->stream, &vertices));
+	input_close(input);
+    } else {
+	if (read_threads <= 0)
+	    read_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	g = graph_read_file(argv[optind], read_threads > 0 ? read_threads : 1,
+			    &vertices);
+    }
 /*     graph_print(g, 0); */
 /*     fflush(stdout); */
+    // Vertex v of the relabelled graph is vertex order[v] of the input.
+    vertex *order = NULL, *insertion = NULL;
+    if (relabel) {
+	double start = user_time();
+	if (!csr) {
+	    csr = csr_graph_make(g);
+	    graph_free(g);
+	    g = NULL;
+	}
+	order = csr_graph_order(csr, relabel_order);
+	struct csr_graph *relabelled = csr_graph_permute(csr, order);
+	if (!csr->mapping)	// else the names live in the mapping
+	    csr_graph_free(csr);
+	csr = relabelled;
+	// Keep adding vertices in input order, so only the layout changes.
+	insertion = malloc(csr->size * sizeof *insertion);
+	for (vertex v = 0; v < csr->size; v++)
+	    insertion[order[v]] = v;
+	if (binary_out)
+	    permute_names(order, csr->size, &vertices, &numbers);
+	if (verbose)
+	    fprintf(stderr, "relabelled in %.2fs\n", user_time() - start);
+    }
+    if (binary_out)
+	exit(write_binary(g, csr, vertices, numbers) ? 0 : 1);
     size_t occ_size;
+    size_t size = csr ? csr_graph_size(csr) : graph_size(g);
+    size_t num_edges = csr ? csr_graph_num_edges(csr) : graph_num_edges(g);
 
     if (!edge_occ) {
-	struct bitvec *occ = find_occ(g);
+	// Vertex covers never change the graph, so freeze it.
+	if (!csr) {
+	    csr = csr_graph_make(g);
+	    graph_free(g);
+	}
+	if (insert && strcmp(insert, "number") != 0 && !downwards) {
+	    free(insertion);
+	    if (strcmp(insert, "heuristic") == 0) {
+		struct bitvec *h = best_heuristic(csr);
+		size_t n = 0;
+		insertion = malloc(csr->size * sizeof *insertion);
+		for (vertex v = 0; v < csr->size; v++)
+		    if (!bitvec_get(h, v))
+			insertion[n++] = v;
+		BITVEC_ITER(h, v)
+		    insertion[n++] = v;
+		free(h);
+	    } else {
+		insertion = csr_graph_order(csr, insert_order);
+	    }
+	}
+	struct bitvec *occ = find_occ(csr, insertion);
+	if (verbose && speculation > 0)
+	    fprintf(stderr, "speculative steps: %zu hits, %zu misses\n",
+		    speculation_hits, speculation_misses);
+	if (verbose && enum2col)
+	    fprintf(stderr, "%llu search nodes\n", search_nodes);
 	occ_size = bitvec_count(occ);
+	if (order) {
+	    struct bitvec *input_occ = bitvec_make(size);
+	    BITVEC_ITER(occ, v)
+		bitvec_set(input_occ, order[v]);
+	    free(occ);
+	    occ = input_occ;
+	}
 	if (!stats_only)
 	    BITVEC_ITER(occ, v)
-		puts(vertices[v]);
+		print_vertex(v, vertices, numbers, '\n');
     }  else {
+	if (!g)
+	    g = csr_graph_thaw(csr);
 	struct edge_occ *occ = find_edge_occ(g);
 	occ_size = occ->size;
 	if (!stats_only)
-	    for (size_t i = 0; i < occ->size; i++)
-		printf("%s %s\n",
-		       vertices[occ->edges[i].v], vertices[occ->edges[i].w]);
+	    for (size_t i = 0; i < occ->size; i++) {
+		vertex v = occ->edges[i].v, w = occ->edges[i].w;
+		print_vertex(order ? order[v] : v, vertices, numbers, ' ');
+		print_vertex(order ? order[w] : w, vertices, numbers, '\n');
+	    }
     }
     
+    if (verbose)
+	fprintf(stderr, "largest intermediate cover: %zu\n", peak_occ_size);
     if (stats_only)
 	printf("%5zd %6zd %5zd %10.2f %16llu\n",
-	       g->size, graph_num_edges(g), occ_size, user_time(), augmentations);
+	       size, num_edges, occ_size, user_time(), augmentations);
 
     return 0;
 }
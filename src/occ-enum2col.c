@@ -1,10 +1,15 @@
 #include "bitvec.h"
+#include "csr-graph.h"
 #include "flow.h"
 #include "graph.h"
 #include "occ.h"
+#include "sparse-set.h"
+#include "util.h"
 
 extern bool verbose;
-extern unsigned long long augmentations;
+extern THREAD_LOCAL unsigned long long augmentations;
+extern THREAD_LOCAL unsigned long long search_nodes;
+static THREAD_LOCAL unsigned long long mirrors_skipped;
 
 enum color { GREY, BLACK, WHITE, RED };
 
@@ -14,19 +19,19 @@ static struct bitvec* assemble_occ(struct occ_problem *problem,
 	fprintf(stderr, "found small cut; ");
 
     struct bitvec *occ = bitvec_make(problem->g->size);
-    ALLOCA_BITVEC(cut, problem->h->size);
-    ALLOCA_BITVEC(sources, problem->h->size);
+    struct sparse_set *sources = sparse_set_make(problem->h->size);
     for (size_t i = 0; i < problem->occ_size; i++) {
 	vertex v = problem->occ_vertices[i];
 	if (colors[i] == WHITE)
-	    bitvec_set(sources, v);
+	    sparse_set_insert(sources, v);
 	else if (colors[i] == BLACK)
-	    bitvec_set(sources, problem->clones[v]);
+	    sparse_set_insert(sources, problem->clones[v]);
 	else
 	    bitvec_set(occ, v);
     }
     
-    cut = flow_vertex_cut(problem->flow, sources);
+    struct bitvec *cut = flow_vertex_cut(problem->flow, sources);
+    sparse_set_free(sources);
     BITVEC_ITER(cut, v) {
 	if (v >= problem->first_clone)
 	    v = problem->occ_vertices[v - problem->first_clone];
@@ -51,18 +56,70 @@ static void remove_pair(struct occ_problem *problem, vertex v) {
     vertex t2 = flow_drain_source(problem->flow, s);
     if (t2 != t) {
 	vertex s2 = flow_drain_target(problem->flow, t);
-	graph_vertex_disable(problem->h, s);
-	graph_vertex_disable(problem->h, t);
-	flow_augment_pair(problem->flow, s2, t2);
+	csr_graph_vertex_disable(problem->h, s);
+	csr_graph_vertex_disable(problem->h, t);
+	flow_augment_pair_bidir(problem->flow, s2, t2);
 	augmentations++;
-	graph_vertex_enable(problem->h, s);
-	graph_vertex_enable(problem->h, t);
+	csr_graph_vertex_enable(problem->h, s);
+	csr_graph_vertex_enable(problem->h, t);
     }
 }
 
+// The grey vertex to branch on next, or occ_size if there is none.
+static size_t pick_vertex(const struct occ_problem *problem,
+			  const struct graph *occ_g, const enum color *colors) {
+    size_t best = problem->occ_size;
+    unsigned long long best_score = 0;
+    for (size_t i = 0; i < problem->occ_size; i++) {
+	if (colors[i] != GREY)
+	    continue;
+	if (problem->branch == OCC_BRANCH_FIRST)
+	    return i;
+	unsigned long long score = 0;
+	vertex j;
+	switch (problem->branch) {
+	case OCC_BRANCH_COLORED:
+	    // by colored neighbors, then by degree
+	    if (graph_vertex_exists(occ_g, i))
+		GRAPH_NEIGHBORS_ITER(occ_g, i, j)
+		    if (colors[j] == BLACK || colors[j] == WHITE)
+			score += problem->occ_size;
+	    // fall through
+	case OCC_BRANCH_DEGREE:
+	    if (graph_vertex_exists(occ_g, i))
+		score += occ_g->vertices[i]->deg;
+	    break;
+	case OCC_BRANCH_FAILURES:
+	    score = problem->stats[problem->occ_vertices[i]].failures;
+	    break;
+	default:
+	    break;
+	}
+	if (best == problem->occ_size || score > best_score) {
+	    best = i;
+	    best_score = score;
+	}
+    }
+    return best;
+}
+
+/* Whether no vertex is black or white. Swapping black and white swaps
+   the sources and targets, which leaves the flow the same, so then the
+   black branch of a free vertex mirrors its white one.  */
+static bool none_colored(const enum color *colors, size_t n) {
+    for (size_t i = 0; i < n; i++)
+	if (colors[i] == BLACK || colors[i] == WHITE)
+	    return false;
+    return true;
+}
+
 static struct bitvec *branch(struct occ_problem *problem, struct graph *occ_g,
 			     enum color *colors, struct bitvec *in_queue,
 			     vertex *qhead, vertex *qtail) {
+    if (problem->cancel
+	&& __atomic_load_n(problem->cancel, __ATOMIC_RELAXED))
+	return NULL;
+    search_nodes++;
     ALLOCA_U_BITVEC(in_queue_backup, occ_g->size);
     bitvec_copy(in_queue_backup, in_queue);
     vertex *qtail_backup = qtail;
@@ -71,11 +128,7 @@ static struct bitvec *branch(struct occ_problem *problem, struct graph *occ_g,
     // Find a vertex to branch on.
     size_t i;
     if (qhead == qtail) {
-	// might optimize: don't start at 0
-	for (i = 0; i < problem->occ_size; i++) {
-	    if (colors[i] == GREY)
-		break;
-	}
+	i = pick_vertex(problem, occ_g, colors);
 	if (i == problem->occ_size) {
             return NULL;
 	} else {
@@ -111,12 +164,13 @@ static struct bitvec *branch(struct occ_problem *problem, struct graph *occ_g,
     }
 
     bool was_grey = color == GREY;
+    bool mirrored = was_grey && none_colored(colors, problem->occ_size);
     if (was_grey)
         color = WHITE;
 
     colors[i] = color;
-    graph_vertex_enable(problem->h, v);
-    graph_vertex_enable(problem->h, v2);
+    csr_graph_vertex_enable(problem->h, v);
+    csr_graph_vertex_enable(problem->h, v2);
 
     vertex s, t;
     if (color == WHITE)
@@ -124,20 +178,28 @@ static struct bitvec *branch(struct occ_problem *problem, struct graph *occ_g,
     else
 	s = v2, t = v;
     augmentations++;
-    if (!flow_augment_pair(problem->flow, s, t))
+    if (!flow_augment_pair_bidir(problem->flow, s, t)) {
+	if (problem->stats)
+	    problem->stats[v].failures++;
 	return assemble_occ(problem, colors);
+    }
 
     struct bitvec *new_occ;
     if ((new_occ = branch(problem, occ_g, colors, in_queue, qhead, qtail)))
 	return new_occ;
 
-    if (was_grey) {
+    if (mirrored) {
+	mirrors_skipped++;
+    } else if (was_grey) {
 	// 2nd branch.
 	remove_pair(problem, v);
 	colors[i] = BLACK;
 	augmentations++;
-	if (!flow_augment_pair(problem->flow, v2, v))
+	if (!flow_augment_pair_bidir(problem->flow, v2, v)) {
+	    if (problem->stats)
+		problem->stats[v].failures++;
 	    return assemble_occ(problem, colors);
+	}
 	if ((new_occ = branch(problem, occ_g, colors, in_queue, qhead, qtail)))
 	    return new_occ;
     }
@@ -145,12 +207,12 @@ static struct bitvec *branch(struct occ_problem *problem, struct graph *occ_g,
     bitvec_copy(in_queue, in_queue_backup);
     qtail = qtail_backup;
     remove_pair(problem, v);
-    graph_vertex_disable(problem->h, v);
-    graph_vertex_disable(problem->h, v2);
+    csr_graph_vertex_disable(problem->h, v);
+    csr_graph_vertex_disable(problem->h, v2);
 
 try_red:
     colors[i] = RED;
-    assert(!graph_vertex_exists(problem->h, v));
+    assert(!csr_graph_vertex_exists(problem->h, v));
     if ((new_occ = branch(problem, occ_g, colors, in_queue, qhead, qtail)))
 	return new_occ;
     colors[i] = GREY;
@@ -162,21 +224,28 @@ try_red:
 
 struct bitvec *occ_shrink_enum2col(struct occ_problem *problem) {
     // Construct the induced subgrapg G[occ].
-    struct graph *occ_g = graph_make(problem->occ_size);
+    size_t num_edges = 0, max_edges = 0;
+    for (size_t i = 0; i < problem->occ_size; i++)
+	max_edges += csr_graph_deg(problem->g, problem->occ_vertices[i]);
+    vertex (*edges)[2] = malloc(max_edges * sizeof *edges);
     for (size_t i = 0; i < problem->occ_size; i++) {
 	vertex v = problem->occ_vertices[i], w;
-	GRAPH_NEIGHBORS_ITER(problem->g, v, w) {
+	CSR_NEIGHBORS_ITER(problem->g, v, w) {
 	    if (v < w && bitvec_get(problem->occ, w)) {
-		size_t j = problem->clones[w] - problem->first_clone;
-		graph_connect(occ_g, i, j);		
+		edges[num_edges][0] = i;
+		edges[num_edges][1] = problem->clones[w] - problem->first_clone;
+		num_edges++;
 	    }
 	}
     }
+    struct graph *occ_g = graph_make_arena(problem->occ_size, 2 * num_edges);
+    graph_connect_edges(occ_g, num_edges, (const vertex (*)[2]) edges);
+    free(edges);
 
     for (size_t i = 0; i < problem->occ_size - (problem->last_not_in_occ ? 1 : 0); i++) {
 	vertex v = problem->occ_vertices[i];
-	graph_vertex_disable(problem->h, v);
-	graph_vertex_disable(problem->h, problem->first_clone + i);
+	csr_graph_vertex_disable(problem->h, v);
+	csr_graph_vertex_disable(problem->h, problem->first_clone + i);
     }
 
     enum color colors[problem->occ_size];
@@ -190,7 +259,7 @@ struct bitvec *occ_shrink_enum2col(struct occ_problem *problem) {
 	size_t last = problem->occ_size - 1;
 	vertex last_v = problem->occ_vertices[last], j;
 	colors[last] = WHITE;
-	flow_augment_pair(problem->flow, last_v, problem->clones[last_v]);
+	flow_augment_pair_bidir(problem->flow, last_v, problem->clones[last_v]);
 	augmentations++;
 	if (graph_vertex_exists(occ_g, last)) {
 	    GRAPH_NEIGHBORS_ITER(occ_g, last, j) {
@@ -200,8 +269,13 @@ struct bitvec *occ_shrink_enum2col(struct occ_problem *problem) {
 	}
     }
 
+    unsigned long long nodes = search_nodes;
+    mirrors_skipped = 0;
     struct bitvec *new_occ = branch(problem, occ_g, colors,
 				    in_queue, queue, qtail);
+    if (verbose)
+	fprintf(stderr, "%llu search nodes, %llu mirrored branches "
+		"skipped; ", search_nodes - nodes, mirrors_skipped);
 
     graph_free(occ_g);
     return new_occ;
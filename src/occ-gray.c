@@ -1,15 +1,18 @@
 #include <assert.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <string.h>
 
 #include "bitvec.h"
+#include "csr-graph.h"
 #include "flow.h"
 #include "graph.h"
 #include "occ.h"
+#include "sparse-set.h"
 #include "util.h"
 
 extern bool verbose;
-extern unsigned long long augmentations;
+extern THREAD_LOCAL unsigned long long augmentations;
 
 enum code { SOURCE, DISABLED, TARGET };
 
@@ -23,12 +26,23 @@ static inline void update_vertex(struct occ_problem *problem, size_t i, int g[],
 	    s = v1, t = v2;
 	else
 	    t = v1, s = v2;
-	bitvec_unset(problem->sources, s);
-	bitvec_unset(problem->targets, t);
+	sparse_set_remove(problem->sources, s);
+	sparse_set_remove(problem->targets, t);
 	problem->num_sources--;
-	if (problem->use_graycode)
-	    if (flow_drain_source(problem->flow, s) != t)
+	// When several vertices change at once, draining an earlier one
+	// may already have taken the path of S or T.
+	if (problem->use_graycode) {
+	    size_t drained = flow_drained(problem->flow);
+	    if (flow_is_source(problem->flow, s))
+		flow_drain_source(problem->flow, s);
+	    if (flow_is_target(problem->flow, t))
 		flow_drain_target(problem->flow, t);
+	    if (problem->stats) {
+		struct vertex_stats *c = &problem->stats[v1];
+		c->drain_length += flow_drained(problem->flow) - drained;
+		c->drain_count++;
+	    }
+	}
     }
     if (new_role != DISABLED) {
 	vertex s, t;
@@ -36,14 +50,14 @@ static inline void update_vertex(struct occ_problem *problem, size_t i, int g[],
 	    s = v1, t = v2;
 	else
 	    t = v1, s = v2;
-	bitvec_set(problem->sources, s);
-	bitvec_set(problem->targets, t);
-	graph_vertex_enable(problem->h, s);
-	graph_vertex_enable(problem->h, t);
+	sparse_set_insert(problem->sources, s);
+	sparse_set_insert(problem->targets, t);
+	csr_graph_vertex_enable(problem->h, s);
+	csr_graph_vertex_enable(problem->h, t);
 	problem->num_sources++;
     } else {
-	graph_vertex_disable(problem->h, v1);
-	graph_vertex_disable(problem->h, v2);
+	csr_graph_vertex_disable(problem->h, v1);
+	csr_graph_vertex_disable(problem->h, v2);
     }
     g[i] = new_role;
 }
@@ -55,6 +69,90 @@ unsigned long long ipow(unsigned long long a, unsigned long long b) {
         return a * ipow(a, b - 1);
 }
 
+// Powers of 3 up to the largest that fits.
+#define GRAY_POW3_MAX 41
+static const unsigned long long pow3[GRAY_POW3_MAX] = {
+    1ULL, 3ULL, 9ULL, 27ULL, 81ULL, 243ULL, 729ULL, 2187ULL, 6561ULL,
+    19683ULL, 59049ULL, 177147ULL, 531441ULL, 1594323ULL, 4782969ULL,
+    14348907ULL, 43046721ULL, 129140163ULL, 387420489ULL, 1162261467ULL,
+    3486784401ULL, 10460353203ULL, 31381059609ULL, 94143178827ULL,
+    282429536481ULL, 847288609443ULL, 2541865828329ULL, 7625597484987ULL,
+    22876792454961ULL, 68630377364883ULL, 205891132094649ULL,
+    617673396283947ULL, 1853020188851841ULL, 5559060566555523ULL,
+    16677181699666569ULL, 50031545098999707ULL, 150094635296999121ULL,
+    450283905890997363ULL, 1350851717672992089ULL, 4052555153018976267ULL,
+    12157665459056928801ULL,
+};
+
+/* In the reflected (3, k)-ary Gray code, the digit changed by step s
+   is the number of times 3 divides s. The table has it for s < 3^5.  */
+static const unsigned char gray_digit_table[243] = {
+    0, 0, 0, 1, 0, 0, 1, 0, 0, 2, 0, 0, 1, 0, 0, 1, 0, 0, 2, 0, 0, 1, 0, 0, 1, 0, 0,
+    3, 0, 0, 1, 0, 0, 1, 0, 0, 2, 0, 0, 1, 0, 0, 1, 0, 0, 2, 0, 0, 1, 0, 0, 1, 0, 0,
+    3, 0, 0, 1, 0, 0, 1, 0, 0, 2, 0, 0, 1, 0, 0, 1, 0, 0, 2, 0, 0, 1, 0, 0, 1, 0, 0,
+    4, 0, 0, 1, 0, 0, 1, 0, 0, 2, 0, 0, 1, 0, 0, 1, 0, 0, 2, 0, 0, 1, 0, 0, 1, 0, 0,
+    3, 0, 0, 1, 0, 0, 1, 0, 0, 2, 0, 0, 1, 0, 0, 1, 0, 0, 2, 0, 0, 1, 0, 0, 1, 0, 0,
+    3, 0, 0, 1, 0, 0, 1, 0, 0, 2, 0, 0, 1, 0, 0, 1, 0, 0, 2, 0, 0, 1, 0, 0, 1, 0, 0,
+    4, 0, 0, 1, 0, 0, 1, 0, 0, 2, 0, 0, 1, 0, 0, 1, 0, 0, 2, 0, 0, 1, 0, 0, 1, 0, 0,
+    3, 0, 0, 1, 0, 0, 1, 0, 0, 2, 0, 0, 1, 0, 0, 1, 0, 0, 2, 0, 0, 1, 0, 0, 1, 0, 0,
+    3, 0, 0, 1, 0, 0, 1, 0, 0, 2, 0, 0, 1, 0, 0, 1, 0, 0, 2, 0, 0, 1, 0, 0, 1, 0, 0,
+};
+
+static inline size_t gray_digit(unsigned long long step) {
+    size_t digit = 0;
+    while (step % 243 == 0) {
+	step /= 243;
+	digit += 5;
+    }
+    return digit + gray_digit_table[step % 243];
+}
+
+/* The highest digit whose vertex conflicts with a vertex at a higher
+   digit, or K if there is none. Two enabled cover vertices conflict if
+   an edge of H joins a source of one to a target of the other; no cut
+   can keep both then, and the code with one of them disabled finds a
+   cover at least as small.  */
+static inline size_t conflict_digit(const unsigned long long same[],
+				    const unsigned long long differ[],
+				    const int g[], size_t k) {
+    unsigned long long sources = 0, targets = 0;
+    for (size_t d = k; d-- > 0; ) {
+	if (g[d] == SOURCE) {
+	    if ((same[d] & sources) | (differ[d] & targets))
+		return d;
+	    sources |= 1ULL << d;
+	} else if (g[d] == TARGET) {
+	    if ((same[d] & targets) | (differ[d] & sources))
+		return d;
+	    targets |= 1ULL << d;
+	}
+    }
+    return k;
+}
+
+/* Set the conflict masks of digit I: an edge between the two original
+   vertices or the two clones conflicts if the roles differ, one between
+   an original and a clone if they are the same.  */
+static void conflict_masks(const struct occ_problem *problem, size_t i,
+			   unsigned long long *same,
+			   unsigned long long *differ) {
+    const struct csr_graph *h = problem->h;
+    vertex v1 = problem->occ_vertices[i], v2 = problem->first_clone + i, w;
+    *same = *differ = 0;
+    CSR_NEIGHBORS_ITER(h, v1, w) {
+	if (w >= problem->first_clone)
+	    *same |= 1ULL << (w - problem->first_clone);
+	else if (bitvec_get(problem->occ, w))
+	    *differ |= 1ULL << (problem->clones[w] - problem->first_clone);
+    }
+    CSR_NEIGHBORS_ITER(h, v2, w) {
+	if (w >= problem->first_clone)
+	    *differ |= 1ULL << (w - problem->first_clone);
+	else if (bitvec_get(problem->occ, w))
+	    *same |= 1ULL << (problem->clones[w] - problem->first_clone);
+    }
+}
+
 /*
   Example (3, k)-ary gray code. +: source, -: target, o: disabled (not in Y)
   [ + + + ]
@@ -86,59 +184,126 @@ unsigned long long ipow(unsigned long long a, unsigned long long b) {
   [ - - - ] *
 
   * can be ommitted for symmetry
-  # can be ommitted if we know last is in Y  */
-struct bitvec *occ_shrink_gray(struct occ_problem *problem) {
-    int u[problem->occ_size];	// +1 or -1, current Gray change direction
-    int g[problem->occ_size];
-    for (size_t i = 0; i < problem->occ_size; i++) {
+  # can be ommitted if we know last is in Y
+
+  The flow is only updated for codes that are consistent with the
+  edges between the cover vertices. A conflict at digit d holds until
+  d changes again, so the rest of its block of 3^d codes is skipped.  */
+static ALWAYS_INLINE struct bitvec *
+gray_enumerate(struct occ_problem *problem, size_t k) {
+    int u[k];			// +1 or -1, current Gray change direction
+    int g[k];			// the current code
+    int applied[k];		// the code the flow is set up for
+    unsigned long long same[k], differ[k];
+    for (size_t i = 0; i < k; i++) {
 	u[i] = +1;
-	g[i] = DISABLED;	
-	update_vertex(problem, i, g, SOURCE);
+	g[i] = SOURCE;
+	applied[i] = DISABLED;
+	if (k <= CHAR_BIT * sizeof *same)
+	    conflict_masks(problem, i, &same[i], &differ[i]);
+	else
+	    same[i] = differ[i] = 0;
+	update_vertex(problem, i, applied, DISABLED);
     }
 
-    unsigned long long num_codes;
+    unsigned long long num_codes, skipped = 0;
+    unsigned long long pow = k < GRAY_POW3_MAX ? pow3[k] : ipow(3, k);
     if (problem->last_not_in_occ)
-	num_codes = ipow(3, problem->occ_size) / 3; // see comment above
+	num_codes = pow / 3;	// see comment above
     else
-	num_codes = ipow(3, problem->occ_size) / 2 + 1;
-
-    while (true) {
-	if (!problem->use_graycode)
-	    flow_clear(problem->flow);
-	while (flow_flow(problem->flow) < problem->num_sources
-               && flow_augment(problem->flow, problem->sources, problem->targets))
-            augmentations++;
-
-	if (flow_flow(problem->flow) < problem->num_sources) {
-	    if (verbose)
-		fprintf(stderr, "found small cut; ");
-            struct bitvec *cut = flow_vertex_cut(problem->flow, problem->sources);
-	    struct bitvec *new_occ = bitvec_make(problem->g->size);
-	    bitvec_copy(new_occ, problem->occ);
-	    bitvec_setminus(new_occ, problem->sources);
-	    bitvec_setminus(new_occ, problem->targets);
-	    BITVEC_ITER(cut, v) {
-		if (v >= problem->g->size)
-		    v = problem->occ_vertices[v - problem->first_clone];
-		bitvec_set(new_occ, v);
+	num_codes = pow / 2 + 1;
+    struct bitvec *new_occ = NULL;
+
+    for (unsigned long long step = 1; ; step++) {
+	if (problem->cancel
+	    && __atomic_load_n(problem->cancel, __ATOMIC_RELAXED))
+	    break;
+	size_t d = conflict_digit(same, differ, g, k);
+	if (d < k) {
+	    // Move to the last code of the block, where the digits below
+	    // d are at the other end of their range.
+	    unsigned long long rest = (d < GRAY_POW3_MAX ? pow3[d]
+				       : ipow(3, d)) - 1;
+	    if (rest >= num_codes) {
+		skipped += num_codes;
+		break;
 	    }
-	    assert(occ_is_occ(problem->g, new_occ));
-	    bitvec_free(cut);
-	    return new_occ;	    
-        }
+	    for (size_t e = 0; e < d; e++)
+		g[e] = u[e] > 0 ? TARGET : SOURCE;
+	    step += rest;
+	    num_codes -= rest;
+	    skipped += rest + 1;
+	} else {
+	    for (size_t i = 0; i < k; i++)
+		if (applied[i] != g[i])
+		    update_vertex(problem, i, applied, g[i]);
+	    if (!problem->use_graycode)
+		flow_clear(problem->flow);
+	    while (flow_flow(problem->flow) < problem->num_sources
+		   && flow_augment(problem->flow, problem->sources,
+				   problem->targets))
+		augmentations++;
+
+	    if (flow_flow(problem->flow) < problem->num_sources) {
+		if (verbose)
+		    fprintf(stderr, "found small cut; ");
+		struct bitvec *cut = flow_vertex_cut(problem->flow,
+						     problem->sources);
+		new_occ = bitvec_make(problem->g->size);
+		bitvec_copy_setminus(new_occ, problem->occ,
+				     problem->sources->bits);
+		bitvec_setminus(new_occ, problem->targets->bits);
+		BITVEC_ITER(cut, v) {
+		    if (v >= problem->g->size)
+			v = problem->occ_vertices[v - problem->first_clone];
+		    bitvec_set(new_occ, v);
+		}
+		assert(occ_is_occ(problem->g, new_occ));
+		bitvec_free(cut);
+		break;
+	    }
+	}
 	if (--num_codes == 0)
 	    break;
 
-	// Generate next gray code.
-	size_t i = 0;
-	int j = g[0] + u[0];
-        while(j >= 3 || j < 0) {
-	    u[i] = -u[i];
-	    if (++i >= problem->occ_size)
-		return NULL;
-	    j = g[i] + u[i];
-        }
-	update_vertex(problem, i, g, j);
+	// Generate next gray code: digit i changes, the ones below it
+	// turn around.
+	size_t i = gray_digit(step);
+	if (i >= k)
+	    break;
+	for (size_t e = 0; e < i; e++)
+	    u[e] = -u[e];
+	g[i] += u[i];
     }
-    return NULL;
+    if (verbose)
+	fprintf(stderr, "skipped %llu inconsistent codes; ", skipped);
+    return new_occ;
+}
+
+/* Kernels for small covers, where k is a constant: the state has a
+   fixed size and the loops over digits have constant trip counts.  */
+#define GRAY_KERNEL(k)							\
+    static struct bitvec *gray_##k(struct occ_problem *problem) {	\
+	return gray_enumerate(problem, k);				\
+    }
+GRAY_KERNEL(1)  GRAY_KERNEL(2)  GRAY_KERNEL(3)  GRAY_KERNEL(4)
+GRAY_KERNEL(5)  GRAY_KERNEL(6)  GRAY_KERNEL(7)  GRAY_KERNEL(8)
+GRAY_KERNEL(9)  GRAY_KERNEL(10) GRAY_KERNEL(11) GRAY_KERNEL(12)
+GRAY_KERNEL(13) GRAY_KERNEL(14) GRAY_KERNEL(15) GRAY_KERNEL(16)
+GRAY_KERNEL(17) GRAY_KERNEL(18) GRAY_KERNEL(19) GRAY_KERNEL(20)
+GRAY_KERNEL(21) GRAY_KERNEL(22) GRAY_KERNEL(23) GRAY_KERNEL(24)
+#undef GRAY_KERNEL
+
+static struct bitvec *(*const gray_kernels[])(struct occ_problem *) = {
+    NULL,     gray_1,  gray_2,  gray_3,  gray_4,  gray_5,  gray_6,
+    gray_7,  gray_8,  gray_9,  gray_10, gray_11, gray_12, gray_13,
+    gray_14, gray_15, gray_16, gray_17, gray_18, gray_19, gray_20,
+    gray_21, gray_22, gray_23, gray_24,
+};
+#define GRAY_MAX_KERNEL (sizeof gray_kernels / sizeof *gray_kernels - 1)
+
+struct bitvec *occ_shrink_gray(struct occ_problem *problem) {
+    if (problem->occ_size <= GRAY_MAX_KERNEL)
+	return gray_kernels[problem->occ_size](problem);
+    return gray_enumerate(problem, problem->occ_size);
 }
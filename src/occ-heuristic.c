@@ -1,61 +1,145 @@
 #include <assert.h>
+#include <stdlib.h>
 
 #include "bitvec.h"
+#include "csr-graph.h"
 #include "graph.h"
 #include "occ.h"
 #include "util.h"
 
+/* Bucket queue of vertices by number of conflicts, each bucket a
+   min-heap of vertex numbers so that ties go to the smallest vertex.
+   Conflicts only decrease, so a vertex is pushed again into the lower
+   bucket and its old entry is skipped when popped.  */
+struct bucket {
+    vertex *heap;
+    size_t size, capacity;
+};
+
+static void bucket_push(struct bucket *b, vertex v) {
+    if (b->size == b->capacity) {
+	b->capacity = b->capacity ? 2 * b->capacity : 16;
+	b->heap = realloc(b->heap, b->capacity * sizeof *b->heap);
+    }
+    size_t i = b->size++;
+    while (i > 0 && b->heap[(i - 1) / 2] > v) {
+	b->heap[i] = b->heap[(i - 1) / 2];
+	i = (i - 1) / 2;
+    }
+    b->heap[i] = v;
+}
+
+static vertex bucket_pop(struct bucket *b) {
+    vertex top = b->heap[0], v = b->heap[--b->size];
+    size_t i = 0;
+    while (2 * i + 1 < b->size) {
+	size_t c = 2 * i + 1;
+	if (c + 1 < b->size && b->heap[c + 1] < b->heap[c])
+	    c++;
+	if (v <= b->heap[c])
+	    break;
+	b->heap[i] = b->heap[c];
+	i = c;
+    }
+    b->heap[i] = v;
+    return top;
+}
+
+// Whether V has more neighbors of its own color than of the other.
+static inline bool improvable(const struct csr_graph *g,
+			      const size_t *conflicts, vertex v) {
+    return 2 * conflicts[v] > csr_graph_deg(g, v);
+}
+
 // Return a possibly non-optimal OCC from a heuristic from A. Abdullah.
 // Result is malloced.
-struct bitvec *occ_heuristic(const struct graph *g) {
-    size_t size = graph_size(g);
+struct bitvec *occ_heuristic(const struct csr_graph *g) {
+    size_t size = csr_graph_size(g);
     ALLOCA_BITVEC(colors, size);
     struct bitvec *occ = bitvec_make(size);
     
     for (size_t i = 0; i < size; i++)
 	bitvec_put(colors, i, rand() % 2);
-    
-    for (size_t i = 0; i < size; ) {
-	size_t conflicts = 0, ok = 0;
+
+    // Neighbors of the same color, kept up to date as colors change.
+    size_t *conflicts = calloc(size, sizeof *conflicts);
+    struct bitvec *worklist = bitvec_make(size);
+    for (size_t i = 0; i < size; i++) {
 	vertex w;
-	GRAPH_NEIGHBORS_ITER(g, i, w) {
+	CSR_NEIGHBORS_ITER(g, i, w)
 	    if (bitvec_get(colors, w) == bitvec_get(colors, i))
-		conflicts++;
+		conflicts[i]++;
+	if (improvable(g, conflicts, i))
+	    bitvec_set(worklist, i);
+    }
+
+    // Flip the first vertex with more conflicts than not, until there
+    // is none. Only the flipped vertex and its neighbors change, so
+    // the next one to flip is found from the lowest of them.
+    for (size_t i = bitvec_find(worklist, 0); i != BITVEC_NOT_FOUND; ) {
+	bitvec_toggle(colors, i);
+	bitvec_unset(worklist, i);
+	size_t next = i;
+	vertex w;
+	conflicts[i] = 0;
+	CSR_NEIGHBORS_ITER(g, i, w) {
+	    bool same = bitvec_get(colors, w) == bitvec_get(colors, i);
+	    conflicts[i] += same;
+	    if (w == i)
+		continue;
+	    if (same)
+		conflicts[w]++;
 	    else
-		ok++;
-	}
-	if (conflicts > ok) {
-	    bitvec_toggle(colors, i);
-	    i = 0;
-	} else {
-	    i++;
+		conflicts[w]--;
+	    if (improvable(g, conflicts, w)) {
+		bitvec_set(worklist, w);
+		if (w < next)
+		    next = w;
+	    } else {
+		bitvec_unset(worklist, w);
+	    }
 	}
+	assert(!improvable(g, conflicts, i));
+	i = bitvec_find(worklist, next);
     }
+    bitvec_free(worklist);
 
-    while (true) {
-	// Find node with minimum number of conflicts, and delete
 #if 1
-	// * it
-	vertex worst = 0, max_conflicts = 0;
-	for (size_t i = 0; i < size; i++) {
-	    if (bitvec_get(occ, i))
-		continue;
-	    size_t conflicts = 0;
-	    vertex w;
-	    GRAPH_NEIGHBORS_ITER(g, i, w) {
-		if (!bitvec_get(occ, w)
-		    && bitvec_get(colors, w) == bitvec_get(colors, i))
-		    conflicts++;
-	    }
-	    if (conflicts > max_conflicts) {
-		worst = i;
-		max_conflicts = conflicts;
-	    }
+    // Delete the vertex with the most conflicts, the first of them on
+    // ties, until there are none.
+    size_t max_conflicts = 0;
+    for (size_t i = 0; i < size; i++)
+	if (conflicts[i] > max_conflicts)
+	    max_conflicts = conflicts[i];
+    size_t num_buckets = max_conflicts + 1;
+    struct bucket *buckets = calloc(num_buckets, sizeof *buckets);
+    for (size_t i = 0; i < size; i++)
+	if (conflicts[i] > 0)
+	    bucket_push(&buckets[conflicts[i]], i);
+
+    while (max_conflicts > 0) {
+	struct bucket *b = &buckets[max_conflicts];
+	if (b->size == 0) {
+	    max_conflicts--;
+	    continue;
 	}
-	if (max_conflicts == 0)
-	    break;
+	vertex worst = bucket_pop(b), w;
+	if (bitvec_get(occ, worst) || conflicts[worst] != max_conflicts)
+	    continue;		// stale
 	bitvec_set(occ, worst);
+	CSR_NEIGHBORS_ITER(g, worst, w) {
+	    if (w == worst || bitvec_get(occ, w)
+		|| bitvec_get(colors, w) != bitvec_get(colors, worst))
+		continue;
+	    if (--conflicts[w] > 0)
+		bucket_push(&buckets[conflicts[w]], w);
+	}
+    }
+    for (size_t i = 0; i < num_buckets; i++)
+	free(buckets[i].heap);
+    free(buckets);
 #else
+    while (true) {
 	// * all its conflicting neighbors [Abdullah]; doesn't seem any better
 	vertex best = 0, least_conflicts = size;
 	for (size_t i = 0; i < size; i++) {
@@ -63,7 +147,7 @@ struct bitvec *occ_heuristic(const struct graph *g) {
 		continue;
 	    size_t conflicts = 0;
 	    vertex w;
-	    GRAPH_NEIGHBORS_ITER(g, i, w) {
+	    CSR_NEIGHBORS_ITER(g, i, w) {
 		if (!bitvec_get(occ, w)
 		    && bitvec_get(colors, w) == bitvec_get(colors, i))
 		    conflicts++;
@@ -76,13 +160,14 @@ struct bitvec *occ_heuristic(const struct graph *g) {
 	if (least_conflicts == size)
 	    break;
 	vertex w;
-	GRAPH_NEIGHBORS_ITER(g, best, w) {
+	CSR_NEIGHBORS_ITER(g, best, w) {
 	    if (!bitvec_get(occ, w)
 		&& bitvec_get(colors, w) == bitvec_get(colors, best))
 		bitvec_set(occ, w);
 	}
-#endif
     }
+#endif
+    free(conflicts);
     assert(occ_is_occ(g, occ));
     return occ;
 }
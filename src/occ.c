@@ -4,65 +4,156 @@
 #include <string.h>
 
 #include "bitvec.h"
+#include "csr-graph.h"
 #include "flow.h"
 #include "graph.h"
 #include "occ.h"
+#include "sparse-set.h"
 #include "util.h"
 
 extern bool verbose;
-extern unsigned long long augmentations;
+extern THREAD_LOCAL unsigned long long augmentations;
+extern enum occ_order gray_order;
+extern enum occ_branch branch_order;
+
+static THREAD_LOCAL struct vertex_stats *stats;
+static THREAD_LOCAL size_t num_stats;
+
+void occ_forget_stats(void) {
+    free(stats);
+    stats = NULL;
+    num_stats = 0;
+}
+
+static struct vertex_stats *get_stats(size_t size) {
+    if (size > num_stats) {
+	stats = realloc(stats, size * sizeof *stats);
+	memset(stats + num_stats, 0, (size - num_stats) * sizeof *stats);
+	num_stats = size;
+    }
+    return stats;
+}
+
+struct digit_key {
+    double cost;
+    vertex v;
+};
+
+static int cmp_digit_key(const void *p1, const void *p2) {
+    const struct digit_key *k1 = p1, *k2 = p2;
+    if (k1->cost != k2->cost)
+	return k1->cost < k2->cost ? -1 : 1;
+    return k1->v < k2->v ? -1 : k1->v > k2->v;
+}
+
+/* Fill occ_vertices in the order asked for, cheapest first, with the
+   last vertex, if known, at the end. Without drain statistics yet, a
+   vertex counts as one drain of its degree.  */
+static void order_occ_vertices(struct occ_problem *problem) {
+    const struct csr_graph *g = problem->g;
+    size_t n = 0;
+    BITVEC_ITER(problem->occ, v)
+	if (!problem->last_not_in_occ || v != problem->last)
+	    problem->occ_vertices[n++] = v;
+    if (problem->last_not_in_occ)
+	problem->occ_vertices[n] = problem->last;
+    if (problem->order == OCC_ORDER_NUMBER)
+	return;
+
+    struct digit_key *keys = malloc(n * sizeof *keys);
+    for (size_t i = 0; i < n; i++) {
+	vertex v = problem->occ_vertices[i];
+	keys[i] = (struct digit_key) {csr_graph_deg(g, v), v};
+	if (problem->order == OCC_ORDER_DRAIN) {
+	    const struct vertex_stats *c = &problem->stats[v];
+	    keys[i].cost = (c->drain_length + keys[i].cost)
+		/ (c->drain_count + 1);
+	}
+    }
+    qsort(keys, n, sizeof *keys, cmp_digit_key);
+    for (size_t i = 0; i < n; i++)
+	problem->occ_vertices[i] = keys[i].v;
+    free(keys);
+}
 
 // Construct auxiliary graph  la Reed et al.
-static struct graph *occ_construct_h(struct occ_problem *problem) {
-    size_t size = graph_size(problem->g);
-    assert (bitvec_size(problem->occ) == size);
+static struct csr_graph *occ_construct_h(struct occ_problem *problem) {
+    const struct csr_graph *g = problem->g;
+    const struct bitvec *occ = problem->occ;
+    size_t size = csr_graph_size(g);
+    assert (bitvec_size(occ) == size);
     problem->occ_vertices = calloc(sizeof *problem->occ_vertices, problem->occ_size);
     problem->clones = calloc(sizeof *problem->clones, size);
+    order_occ_vertices(problem);
+    for (size_t i = 0; i < problem->occ_size; i++)
+	problem->clones[problem->occ_vertices[i]] = problem->first_clone + i;
     ALLOCA_BITVEC(coloring, size + problem->occ_size);
-    ALLOCA_BITVEC(not_occ, size);
-    bitvec_copy(not_occ, problem->occ);
-    bitvec_invert(not_occ);
-    problem->h = graph_subgraph(problem->g, not_occ);
-    graph_two_coloring(problem->h, coloring);
-    problem->h = graph_grow(problem->h, size + problem->occ_size);
-    size_t clone = 0;
-    BITVEC_ITER(problem->occ, v) {
-	problem->occ_vertices[clone] = v;
-	problem->clones[v] = problem->first_clone + clone;
-
-	vertex w;
-	GRAPH_NEIGHBORS_ITER(problem->g, v, w) {
-	    if (bitvec_get(problem->occ, w) && v > w)
+    csr_graph_two_coloring(g, occ, coloring);
+    struct csr_graph *h = csr_graph_alloc(size + problem->occ_size);
+
+    // First count the arcs of G - occ and of the edges to the clones,
+    // then fill in the rows in the same order.
+    vertex v, w;
+    for (v = 0; v < size; v++)
+	if (!bitvec_get(occ, v) && csr_graph_vertex_exists(g, v))
+	    CSR_NEIGHBORS_ITER(g, v, w)
+		if (!bitvec_get(occ, w))
+		    csr_graph_count_arc(h, v);
+    BITVEC_ITER(occ, u) {
+	CSR_NEIGHBORS_ITER(g, u, w) {
+	    if (bitvec_get(occ, w) && u > w)
 		continue;
-	    if (bitvec_get(coloring, w))
-		graph_connect(problem->h, v, w);
-	    else
-		graph_connect(problem->h, problem->clones[v], w);
+	    csr_graph_count_arc(h, bitvec_get(coloring, w) ? u : problem->clones[u]);
+	    csr_graph_count_arc(h, w);
 	}
-	clone++;
     }
+    csr_graph_start_rows(h);
 
-    assert(graph_is_bipartite(problem->h));
-    return problem->h;
+    for (v = 0; v < size; v++) {
+	if (bitvec_get(occ, v) || !csr_graph_vertex_exists(g, v))
+	    continue;
+	csr_graph_vertex_enable(h, v);
+	CSR_NEIGHBORS_ITER(g, v, w)
+	    if (!bitvec_get(occ, w))
+		csr_graph_append(h, v, w);
+    }
+    BITVEC_ITER(occ, u) {
+	CSR_NEIGHBORS_ITER(g, u, w) {
+	    if (bitvec_get(occ, w) && u > w)
+		continue;
+	    vertex x = bitvec_get(coloring, w) ? u : problem->clones[u];
+	    csr_graph_append(h, x, w);
+	    csr_graph_append(h, w, x);
+	    csr_graph_vertex_enable(h, x);
+	    csr_graph_vertex_enable(h, w);
+	}
+    }
+
+    problem->h = h;
+    assert(csr_graph_is_bipartite(h));
+    return h;
 }
 
-bool occ_is_occ(const struct graph *g, const struct bitvec *occ) {
+bool occ_is_occ(const struct csr_graph *g, const struct bitvec *occ) {
     assert(g->size == occ->num_bits);
-    ALLOCA_U_BITVEC(not_occ, g->size);
-    bitvec_copy(not_occ, occ);
-    bitvec_invert(not_occ);    
-    struct graph *g2 = graph_subgraph(g, not_occ);
-    bool occ_is_occ = graph_is_bipartite(g2);
-    graph_free(g2);
-    return occ_is_occ;
+    ALLOCA_BITVEC(colors, g->size);
+    return csr_graph_two_coloring(g, occ, colors);
+}
+
+struct bitvec *occ_shrink(const struct csr_graph *g, const struct bitvec *occ,
+			  bool enum2col, bool use_graycode, vertex last) {
+    return occ_shrink_until(g, occ, enum2col, use_graycode, last, NULL);
 }
 
-struct bitvec *occ_shrink(const struct graph *g, const struct bitvec *occ,
-			  bool enum2col, bool use_graycode,
-			  bool last_not_in_occ) {
+struct bitvec *occ_shrink_until(const struct csr_graph *g,
+				const struct bitvec *occ, bool enum2col,
+				bool use_graycode, vertex last,
+				const bool *cancel) {
     assert(occ_is_occ(g, occ));
-    assert(graph_size(g) == bitvec_size(occ));
+    assert(csr_graph_size(g) == bitvec_size(occ));
     size_t occ_size = bitvec_count(occ);
+    bool last_not_in_occ = last != OCC_NO_LAST;
+    assert(!last_not_in_occ || bitvec_get(occ, last));
     if (occ_size == 0 || (last_not_in_occ && occ_size == 1))
         return NULL;
 
@@ -78,7 +169,7 @@ struct bitvec *occ_shrink(const struct graph *g, const struct bitvec *occ,
 	}
 	
     }
-    if (bitvec_count(new_occ) < bitvec_count(occ))
+    if (bitvec_count_setminus(occ, new_occ) > 0)
 	return new_occ;
     bitvec_free(new_occ);
 
@@ -86,14 +177,21 @@ struct bitvec *occ_shrink(const struct graph *g, const struct bitvec *occ,
     struct occ_problem *problem = &(struct occ_problem) {
 	.g               = g,
 	.occ             = occ,
-	.sources	 = bitvec_make(h_size),
-	.targets	 = bitvec_make(h_size),
+	.sources	 = sparse_set_make(h_size),
+	.targets	 = sparse_set_make(h_size),
 	.num_sources     = 0,
 	.use_graycode    = use_graycode,
 	.last_not_in_occ = last_not_in_occ,
+	.last		 = last,
+	.order		 = enum2col ? OCC_ORDER_NUMBER : gray_order,
+	.branch		 = branch_order,
 	.occ_size        = occ_size,
-	.first_clone	 = graph_size(g),
+	.first_clone	 = csr_graph_size(g),
+	.cancel		 = cancel,
     };
+    if (problem->order == OCC_ORDER_DRAIN
+	|| (enum2col && branch_order == OCC_BRANCH_FAILURES))
+	problem->stats = get_stats(g->size);
     occ_construct_h(problem);
     problem->flow = flow_make(problem->h);
 
@@ -106,9 +204,9 @@ struct bitvec *occ_shrink(const struct graph *g, const struct bitvec *occ,
 	fprintf(stderr, "%llu flow augmentations\n",
                 (unsigned long long) augmentations);
 
-    graph_free(problem->h);
-    bitvec_free(problem->sources);
-    bitvec_free(problem->targets);
+    csr_graph_free(problem->h);
+    sparse_set_free(problem->sources);
+    sparse_set_free(problem->targets);
     flow_free(problem->flow);
 
     return new_occ;
@@ -6,27 +6,68 @@
 #include "graph.h"
 
 struct bitvec;
+struct csr_graph;
 struct flow;
+struct sparse_set;
+
+/* How occ_vertices is ordered for the Gray code enumeration, whose
+   first digits change most often: by vertex number, by degree, or by
+   the average length of the flow paths drained so far, so that cheap
+   vertices come first.  */
+enum occ_order {OCC_ORDER_NUMBER, OCC_ORDER_DEGREE, OCC_ORDER_DRAIN};
+
+/* Statistics of a vertex kept across the compression steps of a
+   thread: the flow paths drained when it changes its role in the Gray
+   code, and the failed augmentations when enum2col colors it.  */
+struct vertex_stats {
+    unsigned long long drain_length, drain_count;
+    unsigned long long failures;
+};
+
+/* How enum2col picks the vertex to branch on when no colored vertex
+   has grey neighbors: the first grey one, the one of highest degree in
+   G[occ], the one with the most colored neighbors, or the one whose
+   augmentation failed most often.  */
+enum occ_branch {
+    OCC_BRANCH_FIRST, OCC_BRANCH_DEGREE, OCC_BRANCH_COLORED,
+    OCC_BRANCH_FAILURES
+};
+
+// No vertex is known to stay out of a smaller cover.
+#define OCC_NO_LAST ((vertex) -1)
 
 struct occ_problem {
-    const struct graph *g;	// input graph
-    struct graph *h;		// G' as described by Reed et al.
+    const struct csr_graph *g;	// input graph
+    struct csr_graph *h;	// G' as described by Reed et al.
     const struct bitvec *occ;	// known odd cycle cover for g
     vertex *occ_vertices;	// array of the k vertices in occ
     vertex *clones;		// clones[v] contains the clone of [v] or 0
-    struct bitvec *sources, *targets; // for the flow
+    struct sparse_set *sources, *targets; // for the flow
     struct flow *flow;
     size_t num_sources;
     bool use_graycode;
-    bool last_not_in_occ;
+    bool last_not_in_occ;	// occ_vertices[occ_size - 1] is not in it
+    vertex last;		// that vertex, or OCC_NO_LAST
+    enum occ_order order;
+    enum occ_branch branch;
+    struct vertex_stats *stats;	// by vertex, if the orders need them
     size_t occ_size, first_clone;
+    const bool *cancel;	// give up once this becomes true, read atomically
 };
 
-bool occ_is_occ(const struct graph *g, const struct bitvec *occ);
-struct bitvec *occ_shrink(const struct graph *g, const struct bitvec *occ,
-			  bool enum2col, bool use_graycode,
-			  bool last_not_in_occ);
-struct bitvec *occ_heuristic(const struct graph *g);
+bool occ_is_occ(const struct csr_graph *g, const struct bitvec *occ);
+// LAST, unless it is OCC_NO_LAST, is known not to be in a smaller cover.
+struct bitvec *occ_shrink(const struct csr_graph *g, const struct bitvec *occ,
+			  bool enum2col, bool use_graycode, vertex last);
+// Like occ_shrink, but gives up and returns NULL once *CANCEL is true.
+// Another thread may set *CANCEL; it is accessed with __atomic builtins.
+struct bitvec *occ_shrink_until(const struct csr_graph *g,
+				const struct bitvec *occ, bool enum2col,
+				bool use_graycode, vertex last,
+				const bool *cancel);
+// Free the vertex statistics kept by this thread.
+void occ_forget_stats(void);
+struct bitvec *occ_heuristic(const struct csr_graph *g);
 
 struct bitvec *occ_shrink_gray(struct occ_problem *problem);
 struct bitvec *occ_shrink_enum2col(struct occ_problem *problem);
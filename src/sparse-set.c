@@ -0,0 +1,27 @@
+#include <stdlib.h>
+
+#include "bitvec.h"
+#include "sparse-set.h"
+
+struct sparse_set *sparse_set_make(size_t capacity) {
+    struct sparse_set *s = malloc(sizeof *s);
+    s->size = 0;
+    s->members = malloc(capacity * sizeof *s->members);
+    s->index = malloc(capacity * sizeof *s->index);
+    s->bits = bitvec_make(capacity);
+    return s;
+}
+
+void sparse_set_free(struct sparse_set *s) {
+    free(s->members);
+    free(s->index);
+    bitvec_free(s->bits);
+    free(s);
+}
+
+void sparse_set_clear(struct sparse_set *s) {
+    vertex v;
+    SPARSE_SET_ITER(s, v)
+	bitvec_unset(s->bits, v);
+    s->size = 0;
+}
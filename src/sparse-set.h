@@ -0,0 +1,55 @@
+#ifndef SPARSE_SET_H
+#define SPARSE_SET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "bitvec.h"
+#include "graph.h"
+
+/* A set of vertices from a universe 0..capacity-1 with O(1) insert,
+   remove and membership test, which can be iterated in time linear
+   in its size rather than in the size of the universe. BITS is kept
+   up to date for use with bitvec operations.  */
+struct sparse_set {
+    size_t size;
+    vertex *members;		// members[0..size) in no particular order
+    vertex *index;		// index[v] is the position of v in members
+    struct bitvec *bits;
+};
+
+struct sparse_set *sparse_set_make(size_t capacity);
+void sparse_set_free(struct sparse_set *s);
+void sparse_set_clear(struct sparse_set *s);
+
+static inline size_t sparse_set_size(const struct sparse_set *s) {
+    return s->size;
+}
+
+static inline bool sparse_set_contains(const struct sparse_set *s,
+				       vertex v) {
+    return bitvec_get(s->bits, v);
+}
+
+static inline void sparse_set_insert(struct sparse_set *s, vertex v) {
+    if (sparse_set_contains(s, v))
+	return;
+    bitvec_set(s->bits, v);
+    s->index[v] = s->size;
+    s->members[s->size++] = v;
+}
+
+static inline void sparse_set_remove(struct sparse_set *s, vertex v) {
+    if (!sparse_set_contains(s, v))
+	return;
+    bitvec_unset(s->bits, v);
+    vertex last = s->members[--s->size];
+    s->members[s->index[v]] = last;
+    s->index[last] = s->index[v];
+}
+
+#define SPARSE_SET_ITER(s, v)						\
+    for (const vertex *__pv = (s)->members, *__pv_end = __pv + (s)->size; \
+	 __pv != __pv_end && (v = *__pv, 1); __pv++)
+
+#endif	// SPARSE_SET_H
@@ -20,8 +20,17 @@ bool get_line(char **lineptr, size_t *n, FILE *stream);
 
 #ifdef __GNUC__
 #define UNUSED __attribute__((unused))
+#define ALWAYS_INLINE inline __attribute__((always_inline))
 #else
 #define UNUSED
+#define ALWAYS_INLINE inline
+#endif
+
+/// Storage class of globals that every thread has its own copy of.
+#ifdef __GNUC__
+#define THREAD_LOCAL __thread
+#else
+#define THREAD_LOCAL _Thread_local
 #endif
 
 #endif	// UTIL_H